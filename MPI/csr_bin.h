@@ -0,0 +1,65 @@
+// Binary CSR file format shared by q1 and its tools.
+//
+// Layout (little-endian, as written by the host):
+//   CsrBinHeader
+//   CsrBinMatrix[num_matrices]
+//   for each matrix, in order:
+//     int64_t row_ptr[rows + 1]
+//     int32_t col[nnz]
+//     value   val[nnz]          (value_bytes wide: 4 = int32, 8 = int64)
+//
+// q1 input files hold two matrices (A then B); product files hold one (C).
+// Every section sits at an offset computable from the descriptors alone, so
+// each rank can read or write its own slice without touching the rest.
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+const char CSR_BIN_MAGIC[8] = {'S', 'P', 'M', 'A', 'T', 'B', 'I', 'N'};
+const int32_t CSR_BIN_VERSION = 1;
+
+struct CsrBinHeader {
+    char magic[8];
+    int32_t version;
+    int32_t num_matrices;
+};
+
+struct CsrBinMatrix {
+    int64_t rows, cols, nnz;
+    int32_t value_bytes;
+    int32_t pad;
+};
+
+// Byte offsets of one matrix's sections
+struct CsrBinSections {
+    int64_t row_ptr, col, val, end;
+};
+
+inline CsrBinHeader make_csr_bin_header(int num_matrices) {
+    CsrBinHeader h;
+    memcpy(h.magic, CSR_BIN_MAGIC, sizeof(h.magic));
+    h.version = CSR_BIN_VERSION;
+    h.num_matrices = num_matrices;
+    return h;
+}
+
+inline bool csr_bin_header_ok(const CsrBinHeader& h) {
+    return memcmp(h.magic, CSR_BIN_MAGIC, sizeof(h.magic)) == 0 && h.version == CSR_BIN_VERSION &&
+           h.num_matrices > 0;
+}
+
+// Section offsets for every matrix described in `mats`
+inline std::vector<CsrBinSections> csr_bin_layout(const std::vector<CsrBinMatrix>& mats) {
+    std::vector<CsrBinSections> out(mats.size());
+    int64_t pos = sizeof(CsrBinHeader) + mats.size() * sizeof(CsrBinMatrix);
+    for (size_t i = 0; i < mats.size(); i++) {
+        out[i].row_ptr = pos;
+        out[i].col = out[i].row_ptr + (mats[i].rows + 1) * (int64_t)sizeof(int64_t);
+        out[i].val = out[i].col + mats[i].nnz * (int64_t)sizeof(int32_t);
+        out[i].end = out[i].val + mats[i].nnz * (int64_t)mats[i].value_bytes;
+        pos = out[i].end;
+    }
+    return out;
+}
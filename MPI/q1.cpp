@@ -1,269 +1,1329 @@
 #include <mpi.h>
 #include <iostream>
 #include <vector>
-#include <unordered_map>
+#include <string>
+#include <cstring>
+#include <cstdlib>
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include "csr_bin.h"
+#include "spgemm.h"
+#include "../common/mpi_profile.h"
+#include "../common/wire_codec.h"
 
 using namespace std;
 
-int main(int argc, char** argv) {
-    int rank, size;
-    MPI_Init(&argc, &argv);
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
+// Appends n items to a byte buffer bound for an MPI_BYTE exchange
+template <class T>
+void pack(vector<char>& buf, const T* data, size_t n) {
+    buf.insert(buf.end(), (const char*)data, (const char*)(data + n));
+}
 
-    int N, M, P, total_nnz = 0;
-    vector<vector<int>> A_cols, A_vals, B_cols, B_vals;
+// Copies n items out of a byte buffer at `pos` and advances it
+template <class T>
+void unpack(const char* buf, size_t& pos, T* out, size_t n) {
+    memcpy(out, buf + pos, n * sizeof(T));
+    pos += n * sizeof(T);
+}
+
+// --compress: a CSR matrix as varints, columns as deltas (sorted within a row)
+void encode_csr(vector<char>& buf, const CSR& m) {
+    WireWriter w(buf);
+    w.put(m.rows);
+    w.put(m.cols);
+    vector<int> lens(m.rows);
+    for (int i = 0; i < m.rows; i++) lens[i] = m.row_ptr[i + 1] - m.row_ptr[i];
+    w.values(lens.data(), m.rows);
+    w.deltas(m.col.data(), m.nnz());
+    w.values(m.val.data(), m.nnz());
+}
+
+CSR decode_csr(WireReader& r) {
+    CSR m;
+    m.rows = r.get();
+    m.cols = r.get();
+    vector<int> lens(m.rows);
+    r.values(lens.data(), m.rows);
+    m.row_ptr.assign(m.rows + 1, 0);
+    for (int i = 0; i < m.rows; i++) m.row_ptr[i + 1] = m.row_ptr[i] + lens[i];
+    m.col.resize(m.nnz());
+    m.val.resize(m.nnz());
+    r.deltas(m.col.data(), m.nnz());
+    r.values(m.val.data(), m.nnz());
+    return m;
+}
+
+// Size of a CSR matrix as raw ints: dimensions, row_ptr, cols and vals
+long long csr_raw_bytes(const CSR& m) {
+    return sizeof(int) * (3 + m.rows + 1 + 2LL * m.nnz());
+}
+
+// Replicates `root`'s matrix `m` over `comm` in the compressed format
+void bcast_encoded_csr(CSR& m, int root, MPI_Comm comm, const char* exchange) {
+    int me;
+    MPI_Comm_rank(comm, &me);
+    vector<char> buf;
+    if (me == root) {
+        double t0 = MPI_Wtime();
+        encode_csr(buf, m);
+        wire_codec.encoded(exchange, csr_raw_bytes(m), buf.size(), MPI_Wtime() - t0);
+    }
+    long long bytes = buf.size();
+    MPI_Bcast(&bytes, 1, MPI_LONG_LONG, root, comm);
+    buf.resize(bytes);
+    MPI_Bcast(buf.data(), bytes, MPI_BYTE, root, comm);
+    profiler.bcast(bytes, root, comm);
+    if (me == root) return;
+    double t0 = MPI_Wtime();
+    WireReader r(buf.data(), buf.size());
+    m = decode_csr(r);
+    wire_codec.decoded(exchange, MPI_Wtime() - t0);
+}
+
+// Exact packed size of a row block: ints for the header, row ids, row
+// lengths and columns, value_t for the values
+size_t packed_bytes(size_t rows, size_t entries) {
+    return sizeof(int) * (1 + 2 * rows + entries) + sizeof(value_t) * entries;
+}
+
+// Under --dist=bcast a row can straddle nnz ranges. Its owner is the rank whose
+// range holds the row's first non-zero; every other rank holding a piece of it
+// (only ever a rank's first row) sends that piece to the owner in one small
+// Alltoallv, so afterwards each output row lives on exactly one rank.
+void exchange_boundary_rows(RowBlock& local, const CSR& A, const vector<int>& nnz_starts, int rank, int size) {
+    vector<char> send_buf;
+    int dest = -1;
+    if (!local.rows.empty() && A.row_ptr[local.rows[0]] < nnz_starts[rank]) {
+        int row = local.rows[0];
+        dest = upper_bound(nnz_starts.begin(), nnz_starts.end(), A.row_ptr[row]) - nnz_starts.begin() - 1;
+        int len = local.row_ptr[1];
+        send_buf.reserve(2 * sizeof(int) + len * (sizeof(int) + sizeof(value_t)));
+        pack(send_buf, &row, 1);
+        pack(send_buf, &len, 1);
+        pack(send_buf, local.cols.data(), len);
+        pack(send_buf, local.vals.data(), len);
+
+        // Drop the piece from the local rows
+        local.rows.erase(local.rows.begin());
+        local.row_ptr.erase(local.row_ptr.begin());
+        for (int& ptr : local.row_ptr) ptr -= len;
+        local.cols.erase(local.cols.begin(), local.cols.begin() + len);
+        local.vals.erase(local.vals.begin(), local.vals.begin() + len);
+    }
+
+    vector<int> send_counts(size, 0), send_displs(size, 0);
+    if (dest >= 0) send_counts[dest] = send_buf.size();
+    vector<int> recv_counts(size), recv_displs(size + 1, 0);
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    profiler.collective("Alltoall", size * sizeof(int), size * sizeof(int), size);
+    for (int p = 0; p < size; p++) recv_displs[p + 1] = recv_displs[p] + recv_counts[p];
+    vector<char> recv_buf(recv_displs[size]);
+    MPI_Alltoallv(send_buf.data(), send_counts.data(), send_displs.data(), MPI_BYTE,
+                  recv_buf.data(), recv_counts.data(), recv_displs.data(), MPI_BYTE, MPI_COMM_WORLD);
+    profiler.exchange("Alltoallv", send_counts.data(), recv_counts.data(), size, 1);
+
+    // Pieces arrive in rank order, i.e. in nnz order, all for this rank's last row
+    for (size_t pos = 0; pos < recv_buf.size();) {
+        int row, len;
+        unpack(recv_buf.data(), pos, &row, 1);
+        unpack(recv_buf.data(), pos, &len, 1);
+        vector<int> cols(len);
+        vector<value_t> vals(len);
+        unpack(recv_buf.data(), pos, cols.data(), len);
+        unpack(recv_buf.data(), pos, vals.data(), len);
+        fold_partial_row(local, row, cols.data(), vals.data(), len);
+    }
+}
+
+// Collects every rank's rows on rank 0 with a single MPI_Gatherv of one packed
+// buffer per rank: [num_rows, rows..., row lengths..., cols..., vals...].
+// Sizes are known exactly, so each buffer is allocated once. Ranks own
+// increasing row ranges, so rank 0 prints the buffers in rank order.
+void gather_and_print(const RowBlock& local, int N, int rank, int size) {
+    int num_rows = local.rows.size();
+    vector<int> lens(num_rows);
+    for (int r = 0; r < num_rows; r++) lens[r] = local.row_ptr[r + 1] - local.row_ptr[r];
+    vector<char> packed;
+    if (wire_codec.on()) {
+        double t0 = MPI_Wtime();
+        WireWriter w(packed);
+        w.put(num_rows);
+        w.deltas(local.rows.data(), num_rows);
+        w.values(lens.data(), num_rows);
+        w.deltas(local.cols.data(), local.cols.size());
+        w.values(local.vals.data(), local.vals.size());
+        wire_codec.encoded("gather_rows", packed_bytes(num_rows, local.cols.size()), packed.size(), MPI_Wtime() - t0);
+    } else {
+        packed.reserve(packed_bytes(num_rows, local.cols.size()));
+        pack(packed, &num_rows, 1);
+        pack(packed, local.rows.data(), num_rows);
+        pack(packed, lens.data(), num_rows);
+        pack(packed, local.cols.data(), local.cols.size());
+        pack(packed, local.vals.data(), local.vals.size());
+    }
 
+    int packed_size = packed.size();
+    vector<int> counts(size), displs(size + 1, 0);
+    MPI_Gather(&packed_size, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
     if (rank == 0) {
-        cin >> N >> M >> P;
-        A_cols.resize(N); A_vals.resize(N);
-        B_cols.resize(M); B_vals.resize(M);
-
-        
-        for (int i = 0; i < N; i++) {
-            int k; cin >> k;
-            A_cols[i].resize(k); A_vals[i].resize(k);
-            total_nnz += k;
-            for (int j = 0; j < k; j++) {
-                cin >> A_cols[i][j] >> A_vals[i][j];
-            }
+        for (int p = 0; p < size; p++) displs[p + 1] = displs[p] + counts[p];
+    }
+    vector<char> all(rank == 0 ? displs[size] : 0);
+    MPI_Gatherv(packed.data(), packed_size, MPI_BYTE, all.data(), counts.data(), displs.data(), MPI_BYTE, 0, MPI_COMM_WORLD);
+    profiler.exchange("Gatherv", rank == 0 ? nullptr : &packed_size, rank == 0 ? counts.data() : nullptr,
+                      rank == 0 ? size : 1, 1);
+    if (rank != 0) return;
+
+    // Output final result, rows with no entries print as "0"
+    int next_row = 0;
+    for (int p = 0; p < size; p++) {
+        const char* buf = all.data() + displs[p];
+        size_t pos = 0;
+        int rows_in;
+        vector<int> rows, row_lens, cols;
+        vector<value_t> vals;
+        double t0 = MPI_Wtime();
+        WireReader r(buf, counts[p]);
+        if (wire_codec.on()) rows_in = r.get();
+        else unpack(buf, pos, &rows_in, 1);
+        rows.resize(rows_in);
+        row_lens.resize(rows_in);
+        if (wire_codec.on()) {
+            r.deltas(rows.data(), rows_in);
+            r.values(row_lens.data(), rows_in);
+        } else {
+            unpack(buf, pos, rows.data(), rows_in);
+            unpack(buf, pos, row_lens.data(), rows_in);
+        }
+        size_t entries = 0;
+        for (int len : row_lens) entries += len;
+        cols.resize(entries);
+        vals.resize(entries);
+        if (wire_codec.on()) {
+            r.deltas(cols.data(), entries);
+            r.values(vals.data(), entries);
+            wire_codec.decoded("gather_rows", MPI_Wtime() - t0);
+        } else {
+            unpack(buf, pos, cols.data(), entries);
+            unpack(buf, pos, vals.data(), entries);
         }
 
-        for (int i = 0; i < M; i++) {
-            int k; cin >> k;
-            B_cols[i].resize(k); B_vals[i].resize(k);
-            for (int j = 0; j < k; j++) {
-                cin >> B_cols[i][j] >> B_vals[i][j];
-            }
+        size_t e = 0;
+        for (int r = 0; r < rows_in; r++) {
+            for (; next_row < rows[r]; next_row++) cout << "0\n";
+            cout << row_lens[r];
+            for (int i = 0; i < row_lens[r]; i++, e++) cout << " " << cols[e] << " " << vals[e];
+            cout << "\n";
+            next_row++;
         }
     }
+    for (; next_row < N; next_row++) cout << "0\n";
+}
+
+// Reads `rows` lines of "k c1 v1 ... ck vk" from `in` (stdin by default)
+void read_csr_text(int rows, int cols, CSR& m, istream& in = cin) {
+    m.rows = rows;
+    m.cols = cols;
+    m.row_ptr.assign(rows + 1, 0);
+    for (int i = 0; i < rows; i++) {
+        int k; in >> k;
+        m.row_ptr[i + 1] = m.row_ptr[i] + k;
+        for (int j = 0; j < k; j++) {
+            int c, v; in >> c >> v;
+            m.col.push_back(c);
+            m.val.push_back(v);
+        }
+    }
+}
 
-    
-    MPI_Bcast(&N, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&M, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&P, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&total_nnz, 1, MPI_INT, 0, MPI_COMM_WORLD);
+// Replicates a CSR matrix held by rank 0 on every rank
+void bcast_csr(CSR& m, int rank) {
+    if (wire_codec.on()) {
+        bcast_encoded_csr(m, 0, MPI_COMM_WORLD, "bcast_csr");
+        return;
+    }
+    MPI_Bcast(&m.rows, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&m.cols, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (rank != 0) m.row_ptr.resize(m.rows + 1);
+    MPI_Bcast(m.row_ptr.data(), m.rows + 1, MPI_INT, 0, MPI_COMM_WORLD);
 
-    
-    
+    int total_elems = m.nnz();
     if (rank != 0) {
-        A_cols.resize(N); A_vals.resize(N);
-        B_cols.resize(M); B_vals.resize(M);
+        m.col.resize(total_elems);
+        m.val.resize(total_elems);
     }
+    // SINGLE BATCH BROADCAST
+    MPI_Bcast(m.col.data(), total_elems, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(m.val.data(), total_elems, MPI_INT, 0, MPI_COMM_WORLD);
+    profiler.bcast(sizeof(int) * (m.rows + 1 + 2LL * total_elems), 0, MPI_COMM_WORLD);
+}
 
-    
-    vector<int> A_sizes(N);
-    if (rank == 0) {
-        for (int i = 0; i < N; i++) A_sizes[i] = A_cols[i].size();
+// Contiguous row blocks holding roughly nnz / parts non-zeros each:
+// part p owns rows [splits[p], splits[p + 1]).
+vector<int> balanced_row_splits(const vector<int>& row_ptr, int parts) {
+    int rows = row_ptr.size() - 1;
+    vector<int> splits(parts + 1, rows);
+    long long total = row_ptr[rows];
+    for (int p = 0; p < parts; p++) {
+        int target = total * p / parts;
+        splits[p] = lower_bound(row_ptr.begin(), row_ptr.end(), target) - row_ptr.begin();
     }
-    MPI_Bcast(A_sizes.data(), N, MPI_INT, 0, MPI_COMM_WORLD);
+    splits[0] = 0;
+    for (int p = 1; p <= parts; p++) splits[p] = max(splits[p], splits[p - 1]);
+    return splits;
+}
+
+// Hands every rank its own row block of a matrix held by rank 0
+CSR scatter_rows(const CSR& full, const vector<int>& splits, int rank, int size) {
+    CSR local;
+    local.rows = splits[rank + 1] - splits[rank];
+    local.cols = full.cols;
 
-    // Pack and broadcast all A data efficiently
-    int total_A_elems = 0;
-    for (int sz : A_sizes) total_A_elems += sz;
-    
-    vector<int> A_cols_packed(total_A_elems), A_vals_packed(total_A_elems);
-    
+    vector<int> row_counts(size), row_displs(size), nnz_counts(size), nnz_displs(size);
+    vector<int> row_sizes;
     if (rank == 0) {
-        int pos = 0;
-        for (int i = 0; i < N; i++) {
-            for (int val : A_cols[i]) A_cols_packed[pos++] = val;
+        row_sizes.resize(full.rows);
+        for (int i = 0; i < full.rows; i++) row_sizes[i] = full.row_ptr[i + 1] - full.row_ptr[i];
+        for (int p = 0; p < size; p++) {
+            row_counts[p] = splits[p + 1] - splits[p];
+            row_displs[p] = splits[p];
+            nnz_displs[p] = full.row_ptr[splits[p]];
+            nnz_counts[p] = full.row_ptr[splits[p + 1]] - nnz_displs[p];
         }
-        pos = 0;
-        for (int i = 0; i < N; i++) {
-            for (int val : A_vals[i]) A_vals_packed[pos++] = val;
+    }
+
+    vector<int> local_sizes(local.rows);
+    MPI_Scatterv(row_sizes.data(), row_counts.data(), row_displs.data(), MPI_INT,
+                 local_sizes.data(), local.rows, MPI_INT, 0, MPI_COMM_WORLD);
+    local.row_ptr.assign(local.rows + 1, 0);
+    for (int i = 0; i < local.rows; i++) local.row_ptr[i + 1] = local.row_ptr[i] + local_sizes[i];
+
+    int local_nnz = local.nnz();
+    local.col.resize(local_nnz);
+    local.val.resize(local_nnz);
+    MPI_Scatterv(full.col.data(), nnz_counts.data(), nnz_displs.data(), MPI_INT,
+                 local.col.data(), local_nnz, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Scatterv(full.val.data(), nnz_counts.data(), nnz_displs.data(), MPI_INT,
+                 local.val.data(), local_nnz, MPI_INT, 0, MPI_COMM_WORLD);
+    if (profiler.on()) {
+        long long sent = 0, messages = 0;
+        for (int p = 0; rank == 0 && p < size; p++) {
+            sent += sizeof(int) * (row_counts[p] + 2LL * nnz_counts[p]);
+            messages += row_counts[p] > 0;
         }
+        profiler.collective("Scatterv", sent, sizeof(int) * (local.rows + 2LL * local_nnz), messages);
     }
-    
-    // SINGLE BATCH BROADCAST
-    MPI_Bcast(A_cols_packed.data(), total_A_elems, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(A_vals_packed.data(), total_A_elems, MPI_INT, 0, MPI_COMM_WORLD);
+    return local;
+}
 
-    // Unpack A data
-    if (rank != 0) {
-        int pos = 0;
-        for (int i = 0; i < N; i++) {
-            A_cols[i].resize(A_sizes[i]); A_vals[i].resize(A_sizes[i]);
-            for (int j = 0; j < A_sizes[i]; j++) {
-                A_cols[i][j] = A_cols_packed[pos++];
-            }
+// Fetches the B rows listed in `needed` (sorted, unique) from the ranks owning
+// them under `b_splits`. One request/response exchange: row ids go out, row
+// lengths then cols/vals come back. Row r of the result is B row needed[r].
+CSR fetch_b_rows(const CSR& B_block, const vector<int>& b_splits, const vector<int>& needed, int rank, int size) {
+    vector<int> req_counts(size, 0), req_displs(size + 1, 0);
+    for (int k : needed) {
+        int owner = upper_bound(b_splits.begin(), b_splits.end(), k) - b_splits.begin() - 1;
+        req_counts[owner]++;
+    }
+    for (int p = 0; p < size; p++) req_displs[p + 1] = req_displs[p] + req_counts[p];
+
+    vector<int> serve_counts(size), serve_displs(size + 1, 0);
+    MPI_Alltoall(req_counts.data(), 1, MPI_INT, serve_counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    profiler.collective("Alltoall", size * sizeof(int), size * sizeof(int), size);
+    for (int p = 0; p < size; p++) serve_displs[p + 1] = serve_displs[p] + serve_counts[p];
+
+    vector<int> serve_rows(serve_displs[size]);
+    MPI_Alltoallv(needed.data(), req_counts.data(), req_displs.data(), MPI_INT,
+                  serve_rows.data(), serve_counts.data(), serve_displs.data(), MPI_INT, MPI_COMM_WORLD);
+    profiler.exchange("Alltoallv", req_counts.data(), serve_counts.data(), size, sizeof(int));
+
+    // Answer the requests out of the local block, in the order they arrived
+    int first_owned = b_splits[rank];
+    vector<int> serve_sizes(serve_rows.size());
+    vector<int> entry_counts(size, 0), entry_displs(size + 1, 0);
+    for (int p = 0; p < size; p++) {
+        for (int r = serve_displs[p]; r < serve_displs[p + 1]; r++) {
+            int local_row = serve_rows[r] - first_owned;
+            serve_sizes[r] = B_block.row_ptr[local_row + 1] - B_block.row_ptr[local_row];
+            entry_counts[p] += serve_sizes[r];
         }
-        pos = 0;
-        for (int i = 0; i < N; i++) {
-            for (int j = 0; j < A_sizes[i]; j++) {
-                A_vals[i][j] = A_vals_packed[pos++];
-            }
+        entry_displs[p + 1] = entry_displs[p] + entry_counts[p];
+    }
+    vector<int> serve_cols, serve_vals;
+    serve_cols.reserve(entry_displs[size]);
+    serve_vals.reserve(entry_displs[size]);
+    for (int row : serve_rows) {
+        int local_row = row - first_owned;
+        for (int e = B_block.row_ptr[local_row]; e < B_block.row_ptr[local_row + 1]; e++) {
+            serve_cols.push_back(B_block.col[e]);
+            serve_vals.push_back(B_block.val[e]);
         }
     }
 
-    // Same optimized broadcast for B matrix
-    vector<int> B_sizes(M);
-    if (rank == 0) {
-        for (int i = 0; i < M; i++) B_sizes[i] = B_cols[i].size();
+    CSR fetched;
+    fetched.rows = needed.size();
+    fetched.cols = B_block.cols;
+    vector<int> fetched_sizes(needed.size());
+    MPI_Alltoallv(serve_sizes.data(), serve_counts.data(), serve_displs.data(), MPI_INT,
+                  fetched_sizes.data(), req_counts.data(), req_displs.data(), MPI_INT, MPI_COMM_WORLD);
+    profiler.exchange("Alltoallv", serve_counts.data(), req_counts.data(), size, sizeof(int));
+    fetched.row_ptr.assign(fetched.rows + 1, 0);
+    for (int r = 0; r < fetched.rows; r++) fetched.row_ptr[r + 1] = fetched.row_ptr[r] + fetched_sizes[r];
+
+    vector<int> recv_counts(size, 0), recv_displs(size + 1, 0);
+    for (int p = 0; p < size; p++) {
+        recv_displs[p] = fetched.row_ptr[req_displs[p]];
+        recv_counts[p] = fetched.row_ptr[req_displs[p + 1]] - recv_displs[p];
+    }
+    fetched.col.resize(fetched.nnz());
+    fetched.val.resize(fetched.nnz());
+    MPI_Alltoallv(serve_cols.data(), entry_counts.data(), entry_displs.data(), MPI_INT,
+                  fetched.col.data(), recv_counts.data(), recv_displs.data(), MPI_INT, MPI_COMM_WORLD);
+    MPI_Alltoallv(serve_vals.data(), entry_counts.data(), entry_displs.data(), MPI_INT,
+                  fetched.val.data(), recv_counts.data(), recv_displs.data(), MPI_INT, MPI_COMM_WORLD);
+    profiler.exchange("Alltoallv", entry_counts.data(), recv_counts.data(), size, 2 * sizeof(int));
+    return fetched;
+}
+
+// --dist=rows: every rank holds one nnz-balanced block of A rows and one of
+// B rows, and pulls just the B rows its A columns reference, so per-rank
+// memory is O(local nnz + referenced B) instead of the whole input.
+RowBlock multiply_local_rows(CSR& A_local, CSR& B_block, const vector<int>& a_splits, const vector<int>& b_splits,
+                             int M, int P, int rank, int size, int threads, ThreadStats& stats) {
+    // Deduplicated B rows referenced by this rank's A columns
+    vector<int> needed;
+    for (int k : A_local.col) {
+        if (k >= 0 && k < M) needed.push_back(k);
+    }
+    sort(needed.begin(), needed.end());
+    needed.erase(unique(needed.begin(), needed.end()), needed.end());
+
+    CSR B_needed;
+    {
+        ScopedPhase phase("distribute");
+        B_needed = fetch_b_rows(B_block, b_splits, needed, rank, size);
+        B_block = CSR();
+    }
+
+    // Renumber A's columns to rows of B_needed; out-of-range columns stay out of range
+    for (int& k : A_local.col) {
+        if (k >= 0 && k < M) k = lower_bound(needed.begin(), needed.end(), k) - needed.begin();
+        else k = -1;
+    }
+
+    ScopedPhase phase("multiply");
+    return multiply(A_local, B_needed, P, 0, A_local.nnz(), a_splits[rank], threads, &stats);
+}
+
+// MPI-IO takes int counts, so large sections move in 1 GiB collective steps.
+// Every rank makes the same number of calls, some with nothing left to move.
+const int64_t IO_CHUNK_BYTES = 1 << 30;
+
+void file_io_at_all(MPI_File fh, int64_t offset, void* buf, int64_t bytes, bool write) {
+    long long steps = (bytes + IO_CHUNK_BYTES - 1) / IO_CHUNK_BYTES, max_steps;
+    MPI_Allreduce(&steps, &max_steps, 1, MPI_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+    for (long long s = 0; s < max_steps; s++) {
+        int64_t done = min<int64_t>(s * IO_CHUNK_BYTES, bytes);
+        int count = min<int64_t>(IO_CHUNK_BYTES, bytes - done);
+        char* ptr = (char*)buf + done;
+        if (write) MPI_File_write_at_all(fh, offset + done, ptr, count, MPI_BYTE, MPI_STATUS_IGNORE);
+        else MPI_File_read_at_all(fh, offset + done, ptr, count, MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+    if (write) profiler.collective("File_write_at_all", bytes, 0, 0);
+    else profiler.collective("File_read_at_all", 0, bytes, 0);
+}
+
+// Reads the first `count` + 1 row pointers starting at row `lo`, rebased to 0
+vector<int> read_bin_row_ptr(MPI_File fh, const CsrBinSections& sec, int lo, int count, int64_t* base) {
+    vector<int64_t> raw(count + 1);
+    file_io_at_all(fh, sec.row_ptr + (int64_t)lo * sizeof(int64_t), raw.data(), raw.size() * sizeof(int64_t), false);
+    *base = raw[0];
+    vector<int> row_ptr(count + 1);
+    for (int i = 0; i <= count; i++) row_ptr[i] = raw[i] - raw[0];
+    return row_ptr;
+}
+
+// Reads rows [lo, hi) of one matrix straight from the binary file
+CSR read_bin_rows(MPI_File fh, const CsrBinMatrix& desc, const CsrBinSections& sec, int lo, int hi) {
+    CSR m;
+    m.rows = hi - lo;
+    m.cols = desc.cols;
+    int64_t base;
+    m.row_ptr = read_bin_row_ptr(fh, sec, lo, m.rows, &base);
+    m.col.resize(m.nnz());
+    m.val.resize(m.nnz());
+    file_io_at_all(fh, sec.col + base * sizeof(int32_t), m.col.data(), m.col.size() * sizeof(int32_t), false);
+    file_io_at_all(fh, sec.val + base * sizeof(int32_t), m.val.data(), m.val.size() * sizeof(int32_t), false);
+    return m;
+}
+
+// Opens a binary A/B input and validates its header on every rank
+MPI_File open_bin_input(const string& path, vector<CsrBinMatrix>& mats, int rank) {
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, path.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0) cerr << "Error: could not open " << path << "." << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    CsrBinHeader header;
+    file_io_at_all(fh, 0, &header, sizeof(header), false);
+    if (!csr_bin_header_ok(header) || header.num_matrices != 2) {
+        if (rank == 0) cerr << "Error: " << path << " is not a binary A/B input (see txt2bin)." << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    mats.resize(2);
+    file_io_at_all(fh, sizeof(header), mats.data(), mats.size() * sizeof(CsrBinMatrix), false);
+    if (mats[0].value_bytes != sizeof(int32_t) || mats[1].value_bytes != sizeof(int32_t)) {
+        if (rank == 0) cerr << "Error: " << path << " must hold 32-bit values." << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
-    MPI_Bcast(B_sizes.data(), M, MPI_INT, 0, MPI_COMM_WORLD);
+    return fh;
+}
+
+// Writes C as a binary CSR product file. Rank p owns output rows
+// [row_lo, row_hi); row pointers, cols and vals each land at offsets given by
+// an exclusive scan of the local nnz, all through collective MPI-IO.
+void write_product_bin(const string& path, const RowBlock& local, int row_lo, int row_hi, int N, int P, int rank) {
+    long long local_nnz = local.cols.size(), nnz_offset = 0, total_nnz = 0;
+    MPI_Exscan(&local_nnz, &nnz_offset, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) nnz_offset = 0;
+    MPI_Allreduce(&local_nnz, &total_nnz, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
 
-    int total_B_elems = 0;
-    for (int sz : B_sizes) total_B_elems += sz;
-    
-    vector<int> B_cols_packed(total_B_elems), B_vals_packed(total_B_elems);
-    
+    MPI_File fh;
+    if (rank == 0) MPI_File_delete(path.c_str(), MPI_INFO_NULL);
+    MPI_Barrier(MPI_COMM_WORLD);
+    if (MPI_File_open(MPI_COMM_WORLD, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0) cerr << "Error: could not create " << path << "." << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    vector<CsrBinMatrix> mats = {{N, P, total_nnz, (int32_t)sizeof(value_t), 0}};
+    CsrBinSections sec = csr_bin_layout(mats)[0];
+    vector<char> header;
     if (rank == 0) {
-        int pos = 0;
-        for (int i = 0; i < M; i++) {
-            for (int val : B_cols[i]) B_cols_packed[pos++] = val;
+        CsrBinHeader h = make_csr_bin_header(1);
+        header.insert(header.end(), (char*)&h, (char*)&h + sizeof(h));
+        header.insert(header.end(), (char*)mats.data(), (char*)mats.data() + sizeof(CsrBinMatrix));
+    }
+    file_io_at_all(fh, 0, header.data(), header.size(), true);
+
+    // Row pointers for [row_lo, row_hi), plus the closing one on the last owner
+    bool last = (row_hi == N && row_lo < row_hi) || (N == 0 && rank == 0);
+    vector<int64_t> row_ptr;
+    row_ptr.reserve(row_hi - row_lo + 1);
+    int64_t pos = nnz_offset;
+    size_t r = 0;
+    for (int row = row_lo; row < row_hi; row++) {
+        row_ptr.push_back(pos);
+        if (r < local.rows.size() && local.rows[r] == row) {
+            pos += local.row_ptr[r + 1] - local.row_ptr[r];
+            r++;
         }
-        pos = 0;
-        for (int i = 0; i < M; i++) {
-            for (int val : B_vals[i]) B_vals_packed[pos++] = val;
+    }
+    if (last) row_ptr.push_back(pos);
+    file_io_at_all(fh, sec.row_ptr + (int64_t)row_lo * sizeof(int64_t), row_ptr.data(), row_ptr.size() * sizeof(int64_t), true);
+    file_io_at_all(fh, sec.col + nnz_offset * sizeof(int32_t), (void*)local.cols.data(), local_nnz * sizeof(int32_t), true);
+    file_io_at_all(fh, sec.val + nnz_offset * sizeof(value_t), (void*)local.vals.data(), local_nnz * sizeof(value_t), true);
+    MPI_File_close(&fh);
+}
+
+// ---- --dist=2d: Sparse SUMMA on a q x q process grid ----
+//
+// Grid rank (i, j) holds A(i, j) = A rows [ab[i], ab[i+1]) x k range
+// [kb[j], kb[j+1]) and B(i, j) = B rows [kb[i], kb[i+1]) x cols
+// [pb[j], pb[j+1]), both with local indices. In stage s, A(i, s) is broadcast
+// along grid row i and B(s, j) along grid column j, and every rank adds
+// A(i, s) * B(s, j) into its C(i, j). Per-rank traffic is O(nnz / sqrt(p))
+// instead of the O(nnz) a row-partitioned fetch needs on a dense B pattern.
+struct SummaGrid {
+    int q, i, j;                  // grid side and this rank's coordinates (-1 if idle)
+    MPI_Comm row_comm, col_comm;  // ranks sharing grid row i / grid column j
+};
+
+// Largest square grid that fits; ranks beyond q * q only join the final gather
+SummaGrid make_summa_grid(int rank, int size) {
+    SummaGrid g;
+    g.q = 1;
+    while ((g.q + 1) * (g.q + 1) <= size) g.q++;
+    bool active = rank < g.q * g.q;
+    g.i = active ? rank / g.q : -1;
+    g.j = active ? rank % g.q : -1;
+    MPI_Comm_split(MPI_COMM_WORLD, active ? g.i : MPI_UNDEFINED, g.j, &g.row_comm);
+    MPI_Comm_split(MPI_COMM_WORLD, active ? g.j : MPI_UNDEFINED, g.i, &g.col_comm);
+    return g;
+}
+
+// n items cut into `parts` equal ranges
+vector<int> uniform_splits(int n, int parts) {
+    vector<int> splits(parts + 1);
+    for (int p = 0; p <= parts; p++) splits[p] = (long long)n * p / parts;
+    return splits;
+}
+
+// Rows [lo, hi) of `m`, keeping only columns in [col_lo, col_hi), shifted to start at 0
+CSR extract_block(const CSR& m, int lo, int hi, int col_lo, int col_hi) {
+    CSR block;
+    block.rows = hi - lo;
+    block.cols = col_hi - col_lo;
+    block.row_ptr.assign(block.rows + 1, 0);
+    for (int r = lo; r < hi; r++) {
+        for (int e = m.row_ptr[r]; e < m.row_ptr[r + 1]; e++) {
+            if (m.col[e] < col_lo || m.col[e] >= col_hi) continue;
+            block.col.push_back(m.col[e] - col_lo);
+            block.val.push_back(m.val[e]);
         }
+        block.row_ptr[r - lo + 1] = block.col.size();
     }
-    
-    MPI_Bcast(B_cols_packed.data(), total_B_elems, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(B_vals_packed.data(), total_B_elems, MPI_INT, 0, MPI_COMM_WORLD);
+    return block;
+}
 
-    // Unpack B data
-    if (rank != 0) {
-        int pos = 0;
-        for (int i = 0; i < M; i++) {
-            B_cols[i].resize(B_sizes[i]); B_vals[i].resize(B_sizes[i]);
-            for (int j = 0; j < B_sizes[i]; j++) {
-                B_cols[i][j] = B_cols_packed[pos++];
-            }
+void pack_csr(vector<char>& buf, const CSR& m) {
+    int dims[3] = {m.rows, m.cols, m.nnz()};
+    pack(buf, dims, 3);
+    pack(buf, m.row_ptr.data(), m.rows + 1);
+    pack(buf, m.col.data(), m.nnz());
+    pack(buf, m.val.data(), m.nnz());
+}
+
+CSR unpack_csr(const char* buf, size_t& pos) {
+    int dims[3];
+    unpack(buf, pos, dims, 3);
+    CSR m;
+    m.rows = dims[0];
+    m.cols = dims[1];
+    m.row_ptr.resize(m.rows + 1);
+    m.col.resize(dims[2]);
+    m.val.resize(dims[2]);
+    unpack(buf, pos, m.row_ptr.data(), m.rows + 1);
+    unpack(buf, pos, m.col.data(), dims[2]);
+    unpack(buf, pos, m.val.data(), dims[2]);
+    return m;
+}
+
+// Broadcasts `root`'s block to every rank of `comm` as one packed buffer
+CSR bcast_block(const CSR& mine, int root, MPI_Comm comm) {
+    int me;
+    MPI_Comm_rank(comm, &me);
+    if (wire_codec.on()) {
+        CSR m;
+        if (me == root) m = mine;
+        bcast_encoded_csr(m, root, comm, "summa_bcast");
+        return m;
+    }
+    vector<char> buf;
+    if (me == root) pack_csr(buf, mine);
+    long long bytes = buf.size();
+    MPI_Bcast(&bytes, 1, MPI_LONG_LONG, root, comm);
+    buf.resize(bytes);
+    MPI_Bcast(buf.data(), bytes, MPI_BYTE, root, comm);
+    profiler.bcast(bytes, root, comm);
+    size_t pos = 0;
+    return unpack_csr(buf.data(), pos);
+}
+
+// Sum of two row blocks over the same rows; entries that cancel are dropped
+RowBlock merge_row_blocks(const RowBlock& a, const RowBlock& b) {
+    RowBlock out;
+    out.cols.reserve(a.cols.size() + b.cols.size());
+    out.vals.reserve(a.vals.size() + b.vals.size());
+    size_t i = 0, j = 0;
+    while (i < a.rows.size() || j < b.rows.size()) {
+        bool take_a = j == b.rows.size() || (i < a.rows.size() && a.rows[i] <= b.rows[j]);
+        const RowBlock& src = take_a ? a : b;
+        size_t& r = take_a ? i : j;
+        int begin = src.row_ptr[r];
+        fold_partial_row(out, src.rows[r], src.cols.data() + begin, src.vals.data() + begin, src.row_ptr[r + 1] - begin);
+        r++;
+    }
+    return out;
+}
+
+// Adds one multiply's thread stats into a running total (empty on the first call)
+void add_thread_stats(ThreadStats& total, const ThreadStats& part) {
+    if (total.busy_seconds.empty()) {
+        total = part;
+        return;
+    }
+    for (size_t t = 0; t < part.busy_seconds.size(); t++) {
+        total.busy_seconds[t] += part.busy_seconds[t];
+        total.flops[t] += part.flops[t];
+    }
+    total.dense_rows += part.dense_rows;
+    total.hash_rows += part.hash_rows;
+}
+
+// Runs the q SUMMA stages on an active grid rank. Returns C(i, j) in local
+// row and column indices; thread stats are summed over the stages.
+RowBlock summa_multiply(const SummaGrid& g, const CSR& A_blk, const CSR& B_blk, const vector<int>& pb,
+                        int threads, ThreadStats& stats) {
+    RowBlock C;
+    int width = pb[g.j + 1] - pb[g.j];
+    for (int s = 0; s < g.q; s++) {
+        CSR A_s, B_s;
+        {
+            ScopedPhase phase("distribute");
+            A_s = bcast_block(A_blk, s, g.row_comm);
+            B_s = bcast_block(B_blk, s, g.col_comm);
         }
-        pos = 0;
-        for (int i = 0; i < M; i++) {
-            for (int j = 0; j < B_sizes[i]; j++) {
-                B_vals[i][j] = B_vals_packed[pos++];
+        ScopedPhase phase("multiply");
+        ThreadStats stage;
+        RowBlock partial = multiply(A_s, B_s, width, 0, A_s.nnz(), 0, threads, &stage);
+        C = s == 0 ? move(partial) : merge_row_blocks(C, partial);
+        add_thread_stats(stats, stage);
+    }
+    return C;
+}
+
+// Gathers the C(i, j) of grid row i on (i, 0) and stitches them into full
+// rows with global row and column numbers. Column blocks are disjoint and
+// increasing in j, so each output row is the concatenation of its pieces.
+RowBlock assemble_grid_row(const SummaGrid& g, const RowBlock& C, int row_base, const vector<int>& pb) {
+    int num_rows = C.rows.size();
+    vector<char> packed;
+    packed.reserve(packed_bytes(num_rows, C.cols.size()));
+    vector<int> lens(num_rows);
+    for (int r = 0; r < num_rows; r++) lens[r] = C.row_ptr[r + 1] - C.row_ptr[r];
+    pack(packed, &num_rows, 1);
+    pack(packed, C.rows.data(), num_rows);
+    pack(packed, lens.data(), num_rows);
+    pack(packed, C.cols.data(), C.cols.size());
+    pack(packed, C.vals.data(), C.vals.size());
+
+    int packed_size = packed.size();
+    vector<int> counts(g.q), displs(g.q + 1, 0);
+    MPI_Gather(&packed_size, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, g.row_comm);
+    if (g.j == 0) {
+        for (int p = 0; p < g.q; p++) displs[p + 1] = displs[p] + counts[p];
+    }
+    vector<char> all(g.j == 0 ? displs[g.q] : 0);
+    MPI_Gatherv(packed.data(), packed_size, MPI_BYTE, all.data(), counts.data(), displs.data(), MPI_BYTE, 0, g.row_comm);
+    profiler.exchange("Gatherv", g.j == 0 ? nullptr : &packed_size, g.j == 0 ? counts.data() : nullptr,
+                      g.j == 0 ? g.q : 1, 1);
+    if (g.j != 0) return RowBlock();
+
+    vector<RowBlock> pieces(g.q);
+    for (int p = 0; p < g.q; p++) {
+        const char* buf = all.data() + displs[p];
+        size_t pos = 0;
+        int rows_in;
+        unpack(buf, pos, &rows_in, 1);
+        RowBlock& piece = pieces[p];
+        piece.rows.resize(rows_in);
+        vector<int> row_lens(rows_in);
+        unpack(buf, pos, piece.rows.data(), rows_in);
+        unpack(buf, pos, row_lens.data(), rows_in);
+        for (int len : row_lens) piece.row_ptr.push_back(piece.row_ptr.back() + len);
+        piece.cols.resize(piece.row_ptr.back());
+        piece.vals.resize(piece.row_ptr.back());
+        unpack(buf, pos, piece.cols.data(), piece.cols.size());
+        unpack(buf, pos, piece.vals.data(), piece.vals.size());
+    }
+
+    RowBlock out;
+    vector<size_t> next(g.q, 0);
+    while (true) {
+        int row = -1;
+        for (int p = 0; p < g.q; p++) {
+            if (next[p] < pieces[p].rows.size() && (row < 0 || pieces[p].rows[next[p]] < row)) row = pieces[p].rows[next[p]];
+        }
+        if (row < 0) break;
+        for (int p = 0; p < g.q; p++) {
+            const RowBlock& piece = pieces[p];
+            if (next[p] == piece.rows.size() || piece.rows[next[p]] != row) continue;
+            for (int e = piece.row_ptr[next[p]]; e < piece.row_ptr[next[p] + 1]; e++) {
+                out.cols.push_back(piece.cols[e] + pb[p]);
+                out.vals.push_back(piece.vals[e]);
             }
+            next[p]++;
         }
+        out.rows.push_back(row_base + row);
+        out.row_ptr.push_back(out.cols.size());
     }
+    return out;
+}
 
-    //  Optimal load balancing
-    vector<int> my_work_elements;
-    int nnz_per_proc = total_nnz / size;
-    int nnz_remainder = total_nnz % size;
-    
-    int my_start_nnz, my_end_nnz;
-    if (rank < nnz_remainder) {
-        my_start_nnz = rank * (nnz_per_proc + 1);
-        my_end_nnz = my_start_nnz + nnz_per_proc + 1;
-    } else {
-        my_start_nnz = nnz_remainder * (nnz_per_proc + 1) + (rank - nnz_remainder) * nnz_per_proc;
-        my_end_nnz = my_start_nnz + nnz_per_proc;
-    }
-
-    // Map my non-zero range to actual matrix elements
-    int current_nnz = 0;
-    for (int i = 0; i < N; i++) {
-        for (int j = 0; j < (int)A_cols[i].size(); j++) {
-            if (current_nnz >= my_start_nnz && current_nnz < my_end_nnz) {
-                // This element belongs to me
-                my_work_elements.push_back(i);  // Store row index
-                my_work_elements.push_back(j);  // Store element index within row
+// Rank 0 cuts the text-parsed A and B into the grid blocks and scatters them,
+// A(i, j) then B(i, j) packed in one buffer per grid rank.
+void scatter_grid_blocks(const SummaGrid& g, const CSR& A, const CSR& B, const vector<int>& ab,
+                         const vector<int>& kb, const vector<int>& pb, CSR& A_blk, CSR& B_blk, int rank, int size) {
+    vector<char> all;
+    vector<int> counts(size, 0), displs(size, 0);
+    if (rank == 0) {
+        for (int p = 0; p < g.q * g.q; p++) {
+            int i = p / g.q, j = p % g.q;
+            displs[p] = all.size();
+            pack_csr(all, extract_block(A, ab[i], ab[i + 1], kb[j], kb[j + 1]));
+            pack_csr(all, extract_block(B, kb[i], kb[i + 1], pb[j], pb[j + 1]));
+            counts[p] = all.size() - displs[p];
+        }
+        for (int p = g.q * g.q; p < size; p++) displs[p] = all.size();
+    }
+    int my_bytes;
+    MPI_Scatter(counts.data(), 1, MPI_INT, &my_bytes, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    vector<char> mine(my_bytes);
+    MPI_Scatterv(all.data(), counts.data(), displs.data(), MPI_BYTE, mine.data(), my_bytes, MPI_BYTE, 0, MPI_COMM_WORLD);
+    if (profiler.on()) {
+        long long sent = 0, messages = 0;
+        for (int p = 0; rank == 0 && p < size; p++) {
+            sent += counts[p];
+            messages += counts[p] > 0;
+        }
+        profiler.collective("Scatterv", sent, my_bytes, messages);
+    }
+    if (g.i < 0) return;
+    size_t pos = 0;
+    A_blk = unpack_csr(mine.data(), pos);
+    B_blk = unpack_csr(mine.data(), pos);
+}
+
+// Prints each rank's thread load balance on rank 0's stderr: the busy time of
+// the slowest thread over the mean, and the flop share of the busiest thread.
+void report_thread_balance(const ThreadStats& stats, int rank, int size) {
+    int threads = stats.busy_seconds.size();
+    long long total_flops = 0, max_flops = 0;
+    for (long long f : stats.flops) {
+        total_flops += f;
+        max_flops = max(max_flops, f);
+    }
+    double slowest = 0;
+    for (double t : stats.busy_seconds) slowest = max(slowest, t);
+    double local[3] = {stats.imbalance(), slowest, total_flops > 0 ? (double)max_flops * threads / total_flops : 1.0};
+    vector<double> all(3 * size);
+    MPI_Gather(local, 3, MPI_DOUBLE, all.data(), 3, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (rank != 0) return;
+
+    cerr << "--- THREAD BALANCE ---" << endl;
+    cerr << "THREADS_PER_RANK: " << threads << endl;
+    for (int p = 0; p < size; p++) {
+        cerr << "RANK " << p << " TIME_IMBALANCE: " << all[3 * p] << " SLOWEST_THREAD: " << all[3 * p + 1]
+             << " FLOP_IMBALANCE: " << all[3 * p + 2] << endl;
+    }
+}
+
+// Prints how many output rows each rank built with each accumulator path
+void report_kernel_paths(const ThreadStats& stats, int rank, int size) {
+    long long local[2] = {stats.hash_rows, stats.dense_rows};
+    vector<long long> all(2 * size);
+    MPI_Gather(local, 2, MPI_LONG_LONG, all.data(), 2, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+    if (rank != 0) return;
+
+    long long hash_total = 0, dense_total = 0;
+    cerr << "--- KERNEL PATHS ---" << endl;
+    cerr << "DENSE_MIN_DENSITY: " << kernel_tuning.dense_min_density
+         << " DENSE_MIN_FLOPS: " << kernel_tuning.dense_min_flops << endl;
+    for (int p = 0; p < size; p++) {
+        cerr << "RANK " << p << " HASH_ROWS: " << all[2 * p] << " DENSE_ROWS: " << all[2 * p + 1] << endl;
+        hash_total += all[2 * p];
+        dense_total += all[2 * p + 1];
+    }
+    cerr << "TOTAL HASH_ROWS: " << hash_total << " DENSE_ROWS: " << dense_total << endl;
+}
+
+// ---- --batch: one B, a stream of A matrices ----
+//
+// B is read and distributed once: replicated under --dist=bcast, cut into
+// nnz-balanced row blocks under --dist=rows. Under rows every rank also keeps
+// the B rows earlier jobs fetched for it, so a job only fetches the rows no
+// earlier job referenced. Jobs come from a file or stdin ("N M" followed by
+// N rows of A, back to back) or a directory (one job per file, in name
+// order). Rank 0 parses the next job on a reader thread while the current
+// one runs; the reader only parses and never calls MPI.
+
+// One A matrix of the job stream, held by rank 0
+struct BatchJob {
+    string name;
+    CSR A;
+    bool ok = false;  // false once the stream is exhausted
+    string skip;      // directory mode: why this file is skipped, if it is
+};
+
+// Rank 0's reader over the job source
+struct JobSource {
+    istream* in = &cin;
+    ifstream file;
+    vector<string> paths;  // directory mode
+    bool directory = false;
+    size_t next_path = 0;
+    int count = 0;
+
+    explicit JobSource(const string& src) {
+        if (src == "-") return;
+        if (filesystem::is_directory(src)) {
+            directory = true;
+            for (const auto& entry : filesystem::directory_iterator(src)) {
+                if (entry.is_regular_file()) paths.push_back(entry.path().string());
             }
-            current_nnz++;
-        }
-    }
-
-    //  Process my assigned non-zero elements
-    // row -> (col -> val)
-    unordered_map<int, unordered_map<int, int>> row_results; 
-
-    for (int idx = 0; idx < (int)my_work_elements.size(); idx += 2) {
-        int row = my_work_elements[idx];
-        int elem_idx = my_work_elements[idx + 1];
-        
-        int k = A_cols[row][elem_idx];
-        int a_val = A_vals[row][elem_idx];
-        
-        if (k >= 0 && k < M) {
-            for (int b_idx = 0; b_idx < (int)B_cols[k].size(); b_idx++) {
-                int j = B_cols[k][b_idx];
-                int b_val = B_vals[k][b_idx];
-                row_results[row][j] += a_val * b_val;
+            sort(paths.begin(), paths.end());
+            return;
+        }
+        file.open(src);
+        if (!file) cerr << "Error: could not open " << src << "." << endl;
+        in = &file;
+    }
+
+    BatchJob next() {
+        BatchJob job;
+        ifstream one;
+        istream* src = in;
+        if (directory) {
+            if (next_path == paths.size()) return job;
+            job.name = paths[next_path++];
+            one.open(job.name);
+            if (!one) {
+                job.skip = "could not open the file";
+                return job;
             }
+            src = &one;
+        } else {
+            job.name = "#" + to_string(count);
+        }
+        // A bad file costs only its own job; a bad stream ends the batch
+        int N, M;
+        if (!(*src >> N >> M)) {
+            if (directory) job.skip = "no N M line";
+            return job;
         }
+        read_csr_text(N, M, job.A, *src);
+        if (!*src) {
+            if (directory) job.skip = "the file is truncated";
+            else cerr << "Error: job " << job.name << " is truncated." << endl;
+            return job;
+        }
+        job.ok = true;
+        count++;
+        return job;
+    }
+};
+
+// Remote and local B rows fetched so far, in global row order
+struct BRowCache {
+    vector<int> ids;
+    CSR rows;
+
+    // Merges in `fetched`, whose row r is B row added[r] (sorted, none cached yet)
+    void merge(const vector<int>& added, const CSR& fetched) {
+        if (added.empty()) return;
+        vector<int> merged_ids;
+        CSR merged;
+        merged.rows = ids.size() + added.size();
+        merged.cols = fetched.cols;
+        merged_ids.reserve(merged.rows);
+        merged.row_ptr.reserve(merged.rows + 1);
+        merged.col.reserve(rows.nnz() + fetched.nnz());
+        merged.val.reserve(rows.nnz() + fetched.nnz());
+        size_t i = 0, j = 0;
+        while (i < ids.size() || j < added.size()) {
+            bool old = j == added.size() || (i < ids.size() && ids[i] < added[j]);
+            const CSR& src = old ? rows : fetched;
+            size_t r = old ? i++ : j++;
+            merged_ids.push_back(old ? ids[r] : added[r]);
+            merged.col.insert(merged.col.end(), src.col.begin() + src.row_ptr[r], src.col.begin() + src.row_ptr[r + 1]);
+            merged.val.insert(merged.val.end(), src.val.begin() + src.row_ptr[r], src.val.begin() + src.row_ptr[r + 1]);
+            merged.row_ptr.push_back(merged.col.size());
+        }
+        ids.swap(merged_ids);
+        rows = move(merged);
     }
+};
 
-    
-    // Collect partial results using efficient collective operations
-    
+// Nearest-rank percentile of sorted samples
+double percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t i = (size_t)ceil(p * sorted.size());
+    return sorted[min(sorted.size() - 1, i > 0 ? i - 1 : 0)];
+}
+
+// Runs every job of `src` against the B in `b_path` (text "M P" and M rows).
+// Products go to stdout as "N P" and N rows each, or to OUTPUT.k with
+// --output. Rank 0 reports each job's latency, from having its A in hand to
+// having written C, and after the last job the one-time setup cost and the
+// latency distribution over the jobs after the first `warmup`.
+void run_batch(const string& src, const string& b_path, const string& dist, const string& output_path,
+               int threads, int warmup, bool kernel_stats, int rank, int size) {
+    double setup_start = MPI_Wtime();
+    profiler.phase("read");
+    CSR B;
+    int dims[2] = {0, 0};  // M, P
     if (rank == 0) {
-        vector<unordered_map<int, int>> final_rows(N);
-        
-        // Add master's results
-        for (const auto& row_pair : row_results) {
-            final_rows[row_pair.first] = row_pair.second;
-        }
-        
-        // Collect from all other processes using optimized pattern
-        for (int p = 1; p < size; p++) {
-            int num_rows;
-            MPI_Recv(&num_rows, 1, MPI_INT, p, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            
-            for (int r = 0; r < num_rows; r++) {
-                int row_idx, num_cols;
-                MPI_Recv(&row_idx, 1, MPI_INT, p, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                MPI_Recv(&num_cols, 1, MPI_INT, p, 2, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                
-                if (num_cols > 0) {
-                    vector<int> cols(num_cols), vals(num_cols);
-                    MPI_Recv(cols.data(), num_cols, MPI_INT, p, 3, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                    MPI_Recv(vals.data(), num_cols, MPI_INT, p, 4, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                    
-                    // Merge results
-                    for (int c = 0; c < num_cols; c++) {
-                        final_rows[row_idx][cols[c]] += vals[c];
-                    }
-                }
+        ifstream in(b_path);
+        if (!(in >> dims[0] >> dims[1])) {
+            cerr << "Error: could not read B from " << b_path << " (expected \"M P\" and M rows)." << endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        read_csr_text(dims[0], dims[1], B, in);
+    }
+    MPI_Bcast(dims, 2, MPI_INT, 0, MPI_COMM_WORLD);
+    profiler.bcast(sizeof(dims), 0, MPI_COMM_WORLD);
+    int M = dims[0], P = dims[1];
+
+    profiler.phase("distribute");
+    vector<int> b_splits(size + 1);
+    CSR B_block;
+    BRowCache cache;
+    if (dist == "rows") {
+        if (rank == 0) b_splits = balanced_row_splits(B.row_ptr, size);
+        MPI_Bcast(b_splits.data(), size + 1, MPI_INT, 0, MPI_COMM_WORLD);
+        profiler.bcast(sizeof(int) * (size + 1), 0, MPI_COMM_WORLD);
+        B_block = scatter_rows(B, b_splits, rank, size);
+        B = CSR();
+    } else {
+        bcast_csr(B, rank);
+    }
+    double setup_time = MPI_Wtime() - setup_start;
+
+    JobSource* source = rank == 0 ? new JobSource(src) : nullptr;
+    future<BatchJob> pending;
+    if (rank == 0) pending = async(launch::async, [source] { return source->next(); });
+
+    ThreadStats total_stats;
+    vector<double> latencies;
+    double ingest_wait = 0;
+    int jobs = 0, skipped = 0;
+    long long fetched_total = 0;
+    for (int k = 0;; k++) {
+        profiler.phase("read");
+        BatchJob job;
+        int header[2] = {0, 0};  // status (0 end, 1 run, 2 skip), N
+        if (rank == 0) {
+            double wait_start = MPI_Wtime();
+            job = pending.get();
+            ingest_wait += MPI_Wtime() - wait_start;
+            bool skip = !job.skip.empty();
+            if (job.ok || skip) pending = async(launch::async, [source] { return source->next(); });
+            header[0] = job.ok ? 1 : skip ? 2 : 0;
+            header[1] = job.A.rows;
+            if (skip) {
+                cerr << "JOB " << k << " " << job.name << " SKIPPED: " << job.skip << endl;
+            } else if (job.ok && job.A.cols != M) {
+                cerr << "JOB " << k << " " << job.name << " SKIPPED: A has " << job.A.cols << " columns, B has " << M
+                     << " rows" << endl;
+                header[0] = 2;
             }
         }
-        
-        // Output final result
-        for (int i = 0; i < N; i++) {
-            vector<pair<int, int>> row_result;
-            for (const auto& pair : final_rows[i]) {
-                if (pair.second != 0) {
-                    row_result.push_back({pair.first, pair.second});
-                }
+        double job_start = MPI_Wtime();
+        MPI_Bcast(header, 2, MPI_INT, 0, MPI_COMM_WORLD);
+        profiler.bcast(sizeof(header), 0, MPI_COMM_WORLD);
+        if (header[0] == 0) break;
+        if (header[0] == 2) {
+            skipped++;
+            continue;
+        }
+        int N = header[1];
+        CSR& A = job.A;
+        jobs++;
+
+        profiler.phase("distribute");
+        RowBlock C;
+        ThreadStats stats;
+        int row_lo, row_hi;
+        long long fetched = 0;
+        if (dist == "rows") {
+            vector<int> a_splits(size + 1);
+            if (rank == 0) a_splits = balanced_row_splits(A.row_ptr, size);
+            MPI_Bcast(a_splits.data(), size + 1, MPI_INT, 0, MPI_COMM_WORLD);
+            profiler.bcast(sizeof(int) * (size + 1), 0, MPI_COMM_WORLD);
+            CSR A_local = scatter_rows(A, a_splits, rank, size);
+            A = CSR();
+
+            // Only B rows no earlier job fetched to this rank travel
+            vector<int> needed, missing;
+            for (int c : A_local.col) {
+                if (c >= 0 && c < M) needed.push_back(c);
             }
-            
-            sort(row_result.begin(), row_result.end());
-            
-            cout << row_result.size();
-            for (const auto& p : row_result) {
-                cout << " " << p.first << " " << p.second;
+            sort(needed.begin(), needed.end());
+            needed.erase(unique(needed.begin(), needed.end()), needed.end());
+            set_difference(needed.begin(), needed.end(), cache.ids.begin(), cache.ids.end(), back_inserter(missing));
+            cache.merge(missing, fetch_b_rows(B_block, b_splits, missing, rank, size));
+            fetched = missing.size();
+            for (int& c : A_local.col) {
+                if (c >= 0 && c < M) c = lower_bound(cache.ids.begin(), cache.ids.end(), c) - cache.ids.begin();
+                else c = -1;
             }
-            cout << "\n";
+
+            profiler.phase("multiply");
+            C = multiply(A_local, cache.rows, P, 0, A_local.nnz(), a_splits[rank], threads, &stats);
+            row_lo = a_splits[rank];
+            row_hi = a_splits[rank + 1];
+        } else {
+            bcast_csr(A, rank);
+            int total_nnz = A.nnz();
+            vector<int> nnz_starts(size + 1);
+            for (int p = 0; p <= size; p++) nnz_starts[p] = p * (total_nnz / size) + min(p, total_nnz % size);
+
+            profiler.phase("multiply");
+            C = multiply(A, B, P, nnz_starts[rank], nnz_starts[rank + 1], 0, threads, &stats);
+            profiler.phase("exchange");
+            exchange_boundary_rows(C, A, nnz_starts, rank, size);
+            auto owned_from = [&](int p) {
+                if (p == 0) return 0;
+                if (p == size) return N;
+                return (int)(lower_bound(A.row_ptr.begin(), A.row_ptr.begin() + N, nnz_starts[p]) - A.row_ptr.begin());
+            };
+            row_lo = owned_from(rank);
+            row_hi = owned_from(rank + 1);
+        }
+        add_thread_stats(total_stats, stats);
+
+        profiler.phase("output");
+        if (!output_path.empty()) {
+            write_product_bin(output_path + "." + to_string(k), C, row_lo, row_hi, N, P, rank);
+        } else {
+            if (rank == 0) cout << N << " " << P << "\n";
+            gather_and_print(C, N, rank, size);
         }
+        MPI_Reduce(rank == 0 ? MPI_IN_PLACE : &fetched, &fetched, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        profiler.collective("Reduce", sizeof(fetched), sizeof(fetched), 1);
+        if (rank == 0) {
+            double latency = MPI_Wtime() - job_start;
+            fetched_total += fetched;
+            latencies.push_back(latency);
+            cerr << "JOB " << k << " " << job.name << " ROWS: " << N << " LATENCY: " << latency;
+            if (dist == "rows") cerr << " B_ROWS_FETCHED: " << fetched;
+            cerr << endl;
+        }
+    }
+    cout << flush;
+    delete source;
+    profiler.count("jobs", jobs);
+
+    // Every rank agrees on the job count, so either all report or none does
+    if (threads > 1 && jobs > 0) report_thread_balance(total_stats, rank, size);
+    if (kernel_stats && jobs > 0) report_kernel_paths(total_stats, rank, size);
+    if (rank != 0) return;
+    vector<double> steady(latencies.begin() + min<size_t>(warmup, latencies.size()), latencies.end());
+    sort(steady.begin(), steady.end());
+    double mean = 0;
+    for (double t : steady) mean += t;
+    mean = steady.empty() ? 0 : mean / steady.size();
+    cerr << "--- BATCH SUMMARY ---" << endl;
+    cerr << "SETUP_TIME: " << setup_time << endl;
+    cerr << "JOBS: " << latencies.size() << " SKIPPED: " << skipped << " WARMUP_JOBS: " << min<size_t>(warmup, latencies.size()) << endl;
+    cerr << "JOB_LATENCY_MEDIAN: " << percentile(steady, 0.5) << " P95: " << percentile(steady, 0.95)
+         << " MEAN: " << mean << " MAX: " << (steady.empty() ? 0 : steady.back()) << endl;
+    cerr << "INGEST_WAIT: " << ingest_wait << endl;
+    if (dist == "rows") cerr << "B_ROWS_FETCHED: " << fetched_total << " (summed over ranks, B has " << M << ")" << endl;
+}
+
+int main(int argc, char** argv) {
+    // Only the main thread talks to MPI; worker threads just run the kernel
+    int rank, size, provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    // --dist=bcast (default) replicates A and B on every rank,
+    // --dist=rows ships each rank only the rows it needs,
+    // --dist=2d runs Sparse SUMMA on a sqrt(p) x sqrt(p) grid of 2D blocks.
+    // --input=FILE reads a binary A/B file (see txt2bin) instead of stdin,
+    // --output=FILE writes C as a binary CSR file instead of text on stdout.
+    // --threads=T runs the local multiply on T threads sharing A and B.
+    // --dense-density=F and --dense-min-flops=N set when a row switches from
+    // the hash to the dense accumulator; --kernel-stats reports the split.
+    // --profile[=FILE] emits per-phase times and traffic as one JSON line.
+    // --compress sends matrices and results as delta/varint streams and
+    // reports the compression ratio and codec time per exchange.
+    // --batch=SRC --b=FILE multiplies one B by every A in SRC (a file, - for
+    // stdin, or a directory); --warmup-jobs=W leaves W jobs out of the summary.
+    string dist = "bcast", input_path, output_path, profile_path, batch_src, b_path;
+    int threads = 1, warmup_jobs = 1;
+    bool kernel_stats = false, profile = false;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--dist=", 7) == 0) dist = argv[i] + 7;
+        else if (strncmp(argv[i], "--input=", 8) == 0) input_path = argv[i] + 8;
+        else if (strncmp(argv[i], "--output=", 9) == 0) output_path = argv[i] + 9;
+        else if (strncmp(argv[i], "--threads=", 10) == 0) threads = max(1, atoi(argv[i] + 10));
+        else if (strncmp(argv[i], "--dense-density=", 16) == 0) kernel_tuning.dense_min_density = atof(argv[i] + 16);
+        else if (strncmp(argv[i], "--dense-min-flops=", 18) == 0) kernel_tuning.dense_min_flops = atoll(argv[i] + 18);
+        else if (strcmp(argv[i], "--kernel-stats") == 0) kernel_stats = true;
+        else if (strcmp(argv[i], "--compress") == 0) wire_codec.enable();
+        else if (strncmp(argv[i], "--batch=", 8) == 0) batch_src = argv[i] + 8;
+        else if (strncmp(argv[i], "--b=", 4) == 0) b_path = argv[i] + 4;
+        else if (strncmp(argv[i], "--warmup-jobs=", 14) == 0) warmup_jobs = max(0, atoi(argv[i] + 14));
+        else if (strcmp(argv[i], "--profile") == 0) profile = true;
+        else if (strncmp(argv[i], "--profile=", 10) == 0) {
+            profile = true;
+            profile_path = argv[i] + 10;
+        }
+    }
+    if (dist != "bcast" && dist != "rows" && dist != "2d") {
+        if (rank == 0) cerr << "Error: unknown --dist mode '" << dist << "' (use bcast, rows or 2d)." << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (profile) {
+        profiler.enable();
+        profiler.note("dist", dist);
+        profiler.note("input", input_path.empty() ? "text" : "binary");
+        profiler.note("threads", to_string(threads));
+        profiler.note("wire", wire_codec.on() ? "compressed" : "raw");
+    }
+    if (!batch_src.empty()) {
+        if (dist == "2d" || !input_path.empty() || b_path.empty()) {
+            if (rank == 0) cerr << "Error: --batch needs --b=FILE and --dist=bcast or rows, without --input." << endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        run_batch(batch_src, b_path, dist, output_path, threads, warmup_jobs, kernel_stats, rank, size);
+        wire_codec.report({"bcast_csr", "gather_rows"});
+        profiler.report("q1", profile_path);
+        MPI_Finalize();
+        return 0;
+    }
+
+    profiler.phase("read");
+    int N, M, P;
+    CSR A, B;
+    MPI_File input_fh = MPI_FILE_NULL;
+    vector<CsrBinMatrix> mats;
+    vector<CsrBinSections> sections;
+
+    if (!input_path.empty()) {
+        // Every rank reads the dimensions itself; nothing is parsed or broadcast
+        input_fh = open_bin_input(input_path, mats, rank);
+        sections = csr_bin_layout(mats);
+        N = mats[0].rows;
+        M = mats[0].cols;
+        P = mats[1].cols;
     } else {
-        // Send results efficiently
-        int num_rows = row_results.size();
-        MPI_Send(&num_rows, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
-        
-        for (const auto& row_pair : row_results) {
-            int row_idx = row_pair.first;
-            MPI_Send(&row_idx, 1, MPI_INT, 0, 1, MPI_COMM_WORLD);
-            
-            vector<int> cols, vals;
-            for (const auto& col_pair : row_pair.second) {
-                if (col_pair.second != 0) {
-                    cols.push_back(col_pair.first);
-                    vals.push_back(col_pair.second);
-                }
+        if (rank == 0) {
+            cin >> N >> M >> P;
+            read_csr_text(N, M, A);
+            read_csr_text(M, P, B);
+        }
+
+        MPI_Bcast(&N, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        MPI_Bcast(&M, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        MPI_Bcast(&P, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        profiler.bcast(3 * sizeof(int), 0, MPI_COMM_WORLD);
+    }
+
+    RowBlock row_results;
+    ThreadStats thread_stats;
+    int row_lo, row_hi;  // output rows this rank owns
+    if (dist == "rows") {
+        vector<int> a_splits(size + 1), b_splits(size + 1);
+        CSR A_local, B_block;
+        if (input_fh != MPI_FILE_NULL) {
+            // Splits come from the row pointers; each rank then reads only its slices
+            int64_t base;
+            a_splits = balanced_row_splits(read_bin_row_ptr(input_fh, sections[0], 0, N, &base), size);
+            b_splits = balanced_row_splits(read_bin_row_ptr(input_fh, sections[1], 0, M, &base), size);
+            A_local = read_bin_rows(input_fh, mats[0], sections[0], a_splits[rank], a_splits[rank + 1]);
+            B_block = read_bin_rows(input_fh, mats[1], sections[1], b_splits[rank], b_splits[rank + 1]);
+        } else {
+            profiler.phase("distribute");
+            if (rank == 0) {
+                a_splits = balanced_row_splits(A.row_ptr, size);
+                b_splits = balanced_row_splits(B.row_ptr, size);
             }
-            
-            int num_cols = cols.size();
-            MPI_Send(&num_cols, 1, MPI_INT, 0, 2, MPI_COMM_WORLD);
-            if (num_cols > 0) {
-                MPI_Send(cols.data(), num_cols, MPI_INT, 0, 3, MPI_COMM_WORLD);
-                MPI_Send(vals.data(), num_cols, MPI_INT, 0, 4, MPI_COMM_WORLD);
+            MPI_Bcast(a_splits.data(), size + 1, MPI_INT, 0, MPI_COMM_WORLD);
+            MPI_Bcast(b_splits.data(), size + 1, MPI_INT, 0, MPI_COMM_WORLD);
+            profiler.bcast(2 * sizeof(int) * (size + 1), 0, MPI_COMM_WORLD);
+            A_local = scatter_rows(A, a_splits, rank, size);
+            B_block = scatter_rows(B, b_splits, rank, size);
+            A = CSR();
+            B = CSR();
+        }
+        row_results = multiply_local_rows(A_local, B_block, a_splits, b_splits, M, P, rank, size, threads, thread_stats);
+        row_lo = a_splits[rank];
+        row_hi = a_splits[rank + 1];
+    } else if (dist == "2d") {
+        SummaGrid grid = make_summa_grid(rank, size);
+        vector<int> ab(grid.q + 1), kb = uniform_splits(M, grid.q), pb = uniform_splits(P, grid.q);
+        CSR A_blk, B_blk;
+        if (input_fh != MPI_FILE_NULL) {
+            // Each grid rank reads its A and B row slices and keeps its column block
+            int64_t base;
+            ab = balanced_row_splits(read_bin_row_ptr(input_fh, sections[0], 0, N, &base), grid.q);
+            int ai = max(grid.i, 0), bj = max(grid.j, 0);
+            CSR A_rows = grid.i < 0 ? read_bin_rows(input_fh, mats[0], sections[0], N, N)
+                                    : read_bin_rows(input_fh, mats[0], sections[0], ab[ai], ab[ai + 1]);
+            CSR B_rows = grid.i < 0 ? read_bin_rows(input_fh, mats[1], sections[1], M, M)
+                                    : read_bin_rows(input_fh, mats[1], sections[1], kb[ai], kb[ai + 1]);
+            if (grid.i >= 0) {
+                A_blk = extract_block(A_rows, 0, A_rows.rows, kb[bj], kb[bj + 1]);
+                B_blk = extract_block(B_rows, 0, B_rows.rows, pb[bj], pb[bj + 1]);
             }
+        } else {
+            profiler.phase("distribute");
+            if (rank == 0) ab = balanced_row_splits(A.row_ptr, grid.q);
+            MPI_Bcast(ab.data(), grid.q + 1, MPI_INT, 0, MPI_COMM_WORLD);
+            profiler.bcast(sizeof(int) * (grid.q + 1), 0, MPI_COMM_WORLD);
+            scatter_grid_blocks(grid, A, B, ab, kb, pb, A_blk, B_blk, rank, size);
+            A = CSR();
+            B = CSR();
+        }
+
+        // (i, 0) ends up owning grid row i; everyone else owns an empty range
+        row_lo = row_hi = N;
+        if (grid.i >= 0) {
+            RowBlock C = summa_multiply(grid, A_blk, B_blk, pb, threads, thread_stats);
+            profiler.phase("exchange");
+            row_results = assemble_grid_row(grid, C, ab[grid.i], pb);
+            row_lo = grid.j == 0 ? ab[grid.i] : ab[grid.i + 1];
+            row_hi = ab[grid.i + 1];
+            MPI_Comm_free(&grid.row_comm);
+            MPI_Comm_free(&grid.col_comm);
+        } else {
+            thread_stats.busy_seconds.assign(threads, 0.0);
+            thread_stats.flops.assign(threads, 0);
+        }
+    } else {
+        if (input_fh != MPI_FILE_NULL) {
+            A = read_bin_rows(input_fh, mats[0], sections[0], 0, N);
+            B = read_bin_rows(input_fh, mats[1], sections[1], 0, M);
+        } else {
+            // The packed arrays are already CSR, so they are broadcast as-is
+            profiler.phase("distribute");
+            bcast_csr(A, rank);
+            bcast_csr(B, rank);
+        }
+        int total_nnz = A.nnz();
+
+        //  Optimal load balancing: rank p owns non-zeros [nnz_starts[p], nnz_starts[p + 1])
+        int nnz_per_proc = total_nnz / size;
+        int nnz_remainder = total_nnz % size;
+        vector<int> nnz_starts(size + 1);
+        for (int p = 0; p <= size; p++) {
+            nnz_starts[p] = p * nnz_per_proc + min(p, nnz_remainder);
         }
+
+        //  Process my assigned non-zero elements into sorted CSR rows
+        profiler.phase("multiply");
+        row_results = multiply(A, B, P, nnz_starts[rank], nnz_starts[rank + 1], 0, threads, &thread_stats);
+        profiler.phase("exchange");
+        exchange_boundary_rows(row_results, A, nnz_starts, rank, size);
+
+        // A row belongs to the rank holding its first non-zero
+        auto owned_from = [&](int p) {
+            if (p == 0) return 0;
+            if (p == size) return N;
+            return (int)(lower_bound(A.row_ptr.begin(), A.row_ptr.begin() + N, nnz_starts[p]) - A.row_ptr.begin());
+        };
+        row_lo = owned_from(rank);
+        row_hi = owned_from(rank + 1);
     }
+    if (input_fh != MPI_FILE_NULL) MPI_File_close(&input_fh);
+
+    profiler.phase("output");
+    if (profile) {
+        long long flops = 0;
+        for (long long f : thread_stats.flops) flops += f;
+        profiler.count("flops", flops);
+        profiler.count("output_nnz", row_results.cols.size());
+        profiler.count("hash_rows", thread_stats.hash_rows);
+        profiler.count("dense_rows", thread_stats.dense_rows);
+    }
+    if (threads > 1) report_thread_balance(thread_stats, rank, size);
+    if (kernel_stats) report_kernel_paths(thread_stats, rank, size);
+
+    if (!output_path.empty()) write_product_bin(output_path, row_results, row_lo, row_hi, N, P, rank);
+    else gather_and_print(row_results, N, rank, size);
 
+    wire_codec.report({"bcast_csr", "summa_bcast", "gather_rows"});
+    profiler.report("q1", profile_path);
     MPI_Finalize();
     return 0;
 }
@@ -0,0 +1,515 @@
+// Sparse matrix multiply kernel used by q1: CSR storage, per-row sparse
+// accumulators, and a thread pool that splits the work by estimated flops.
+// Each row picks a hash or a dense (SIMD-compacted) accumulator from its flop
+// count; build with -mavx2 or -mavx512bw (or -march=native) for the vector scan.
+//
+// Each multiply runs in two passes. The symbolic pass counts the distinct
+// columns of every output row, so the output CSR is allocated exactly once;
+// the numeric pass then writes sorted rows straight into place. Entries that
+// cancel to zero are compacted away at the end.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+#if defined(__AVX2__) || defined(__AVX512BW__)
+#include <immintrin.h>
+#endif
+
+// Output values accumulate in this type; inputs stay int. Products of int
+// inputs can overflow int long before they overflow 64 bits.
+#ifndef SPGEMM_VALUE_T
+#define SPGEMM_VALUE_T long long
+#endif
+using value_t = SPGEMM_VALUE_T;
+
+// Above this many output columns a dense accumulator row gets too big to keep
+// per rank, so every row goes through the hash accumulator instead.
+const int DENSE_ACC_MAX_COLS = 1 << 22;
+
+// Per-row kernel choice. A row goes to the dense accumulator when its flop
+// count (partial products) is at least dense_min_flops and at least
+// dense_min_density * P, i.e. when its output is likely to fill a good part
+// of the row; all other rows use the hash accumulator. Set once at startup.
+struct KernelTuning {
+    double dense_min_density = 1.0 / 64;
+    long long dense_min_flops = 256;
+};
+inline KernelTuning kernel_tuning;
+
+// Compressed sparse rows: row i is col/val[row_ptr[i] .. row_ptr[i + 1])
+struct CSR {
+    int rows = 0, cols = 0;
+    std::vector<int> row_ptr{0}, col, val;
+
+    int nnz() const { return row_ptr[rows]; }
+};
+
+// Calls emit(c) for every set flag in used[lo, hi], in column order, and
+// clears them. Vector builds test 64 or 32 flags per step and skip empty
+// stretches; the scalar loop handles the tail and non-SIMD builds.
+template <class Emit>
+inline void scan_flags(char* used, int lo, int hi, Emit emit) {
+    int c = lo;
+#if defined(__AVX512BW__)
+    for (; c + 64 <= hi + 1; c += 64) {
+        __m512i v = _mm512_loadu_si512((const void*)(used + c));
+        uint64_t m = _mm512_test_epi8_mask(v, v);
+        if (!m) continue;
+        _mm512_storeu_si512((void*)(used + c), _mm512_setzero_si512());
+        for (; m; m &= m - 1) emit(c + __builtin_ctzll(m));
+    }
+#elif defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256();
+    for (; c + 32 <= hi + 1; c += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(used + c));
+        unsigned m = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+        if (!m) continue;
+        _mm256_storeu_si256((__m256i*)(used + c), zero);
+        for (; m; m &= m - 1) emit(c + __builtin_ctz(m));
+    }
+#endif
+    for (; c <= hi; c++) {
+        if (used[c]) {
+            used[c] = 0;
+            emit(c);
+        }
+    }
+}
+
+// Dense accumulator: one value slot and one flag per output column. It keeps
+// no list of touched columns; the row's column span is scanned at flush time,
+// which yields the columns already sorted and is cheap when the row is dense.
+struct DenseAccumulator {
+    std::vector<value_t> vals;
+    std::vector<char> used;
+    int lo, hi, count = 0;
+
+    explicit DenseAccumulator(int width) : vals(width, 0), used(width, 0), lo(width), hi(-1) {}
+
+    void insert(int col) {
+        if (!used[col]) {
+            used[col] = 1;
+            count++;
+            lo = std::min(lo, col);
+            hi = std::max(hi, col);
+        }
+    }
+
+    void add(int col, value_t v) {
+        insert(col);
+        vals[col] += v;
+    }
+
+    bool empty() const { return count == 0; }
+
+    void reset_span() {
+        lo = used.size();
+        hi = -1;
+        count = 0;
+    }
+
+    // Symbolic pass: number of distinct columns in the row, then reset
+    int finish_count() {
+        int n = count;
+        if (n > 0) std::fill(used.begin() + lo, used.begin() + hi + 1, 0);
+        reset_span();
+        return n;
+    }
+
+    // Numeric pass: writes the row in column order, then resets
+    int flush_into(int* out_cols, value_t* out_vals) {
+        int n = 0;
+        if (count > 0) {
+            scan_flags(used.data(), lo, hi, [&](int c) {
+                out_cols[n] = c;
+                out_vals[n++] = vals[c];
+                vals[c] = 0;
+            });
+        }
+        reset_span();
+        return n;
+    }
+};
+
+// Open-addressing (linear probing) accumulator, reused across rows. Sized once
+// from the largest row flop count so it never rehashes inside the loop.
+struct HashAccumulator {
+    std::vector<int> keys, touched;
+    std::vector<value_t> vals;
+    unsigned mask;
+
+    explicit HashAccumulator(long long max_row_flops) {
+        size_t cap = 16;
+        while ((long long)cap < 2 * max_row_flops) cap <<= 1;
+        keys.assign(cap, -1);
+        vals.assign(cap, 0);
+        mask = cap - 1;
+    }
+
+    unsigned insert(int col) {
+        unsigned slot = ((unsigned)col * 2654435761u) & mask;
+        while (keys[slot] != col) {
+            if (keys[slot] == -1) {
+                keys[slot] = col;
+                touched.push_back(slot);
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    void add(int col, value_t v) { vals[insert(col)] += v; }
+
+    bool empty() const { return touched.empty(); }
+
+    int finish_count() {
+        int n = touched.size();
+        for (int s : touched) keys[s] = -1;
+        touched.clear();
+        return n;
+    }
+
+    int flush_into(int* out_cols, value_t* out_vals) {
+        std::sort(touched.begin(), touched.end(), [&](int a, int b) { return keys[a] < keys[b]; });
+        int n = 0;
+        for (int s : touched) {
+            out_cols[n] = keys[s];
+            out_vals[n++] = vals[s];
+            keys[s] = -1;
+            vals[s] = 0;
+        }
+        touched.clear();
+        return n;
+    }
+};
+
+// Picks the dense or the hash accumulator row by row (see KernelTuning).
+// The dense one is only allocated once a row needs it, and `dense_rows` /
+// `hash_rows` count the rows each path produced in the numeric pass.
+struct AdaptiveAccumulator {
+    int width;
+    long long dense_from;
+    std::vector<DenseAccumulator> dense;
+    HashAccumulator hash;
+    long long dense_rows = 0, hash_rows = 0;
+
+    AdaptiveAccumulator(int width, long long dense_from, long long max_hash_flops)
+        : width(width), dense_from(dense_from), hash(max_hash_flops) {}
+
+    // Runs body(acc) with the accumulator for a row of `flops` partial
+    // products; `count` adds the row to the path counters.
+    template <class Body>
+    void visit(long long flops, bool count, Body body) {
+        if (flops >= dense_from) {
+            if (dense.empty()) dense.emplace_back(width);
+            dense_rows += count;
+            body(dense[0]);
+        } else {
+            hash_rows += count;
+            body(hash);
+        }
+    }
+};
+
+// Smallest row flop count routed to the dense path for an output width of P
+inline long long dense_threshold(int P) {
+    if (P > DENSE_ACC_MAX_COLS) return LLONG_MAX;
+    long long by_density = (long long)std::ceil(kernel_tuning.dense_min_density * P);
+    return std::max(kernel_tuning.dense_min_flops, by_density);
+}
+
+// Local part of C = A * B: rows[r] has its sorted entries in
+// cols/vals[row_ptr[r] .. row_ptr[r + 1]).
+struct RowBlock {
+    std::vector<int> rows, row_ptr{0}, cols;
+    std::vector<value_t> vals;
+};
+
+// Output structure of one nnz range from the symbolic pass: row rows[r] has
+// exactly row_ptr[r + 1] - row_ptr[r] structural entries.
+struct RangeStructure {
+    std::vector<int> rows, row_ptr{0};
+};
+
+// Calls body(row, lo, hi) for every row of A with entries in [nnz_begin, nnz_end)
+template <class Body>
+void for_each_row_in_range(const CSR& A, int nnz_begin, int nnz_end, Body body) {
+    int first_row = std::upper_bound(A.row_ptr.begin(), A.row_ptr.end(), nnz_begin) - A.row_ptr.begin() - 1;
+    for (int row = std::max(first_row, 0); row < A.rows && A.row_ptr[row] < nnz_end; row++) {
+        int lo = std::max(A.row_ptr[row], nnz_begin);
+        int hi = std::min(A.row_ptr[row + 1], nnz_end);
+        if (lo < hi) body(row, lo, hi);
+    }
+}
+
+// Partial products of A entries [lo, hi) against B
+inline long long range_flops(const CSR& A, const CSR& B, int lo, int hi) {
+    long long flops = 0;
+    for (int e = lo; e < hi; e++) {
+        int k = A.col[e];
+        if (k >= 0 && k < B.rows) flops += B.row_ptr[k + 1] - B.row_ptr[k];
+    }
+    return flops;
+}
+
+// Symbolic pass over the A non-zeros in [nnz_begin, nnz_end): records every
+// output row with at least one structural entry and its exact entry count.
+inline void symbolic_nnz_range(const CSR& A, const CSR& B, int nnz_begin, int nnz_end, int row_offset,
+                               AdaptiveAccumulator& adaptive, RangeStructure& out) {
+    for_each_row_in_range(A, nnz_begin, nnz_end, [&](int row, int lo, int hi) {
+        int n = 0;
+        adaptive.visit(range_flops(A, B, lo, hi), false, [&](auto& acc) {
+            for (int e = lo; e < hi; e++) {
+                int k = A.col[e];
+                if (k < 0 || k >= B.rows) continue;
+                for (int b = B.row_ptr[k]; b < B.row_ptr[k + 1]; b++) acc.insert(B.col[b]);
+            }
+            n = acc.finish_count();
+        });
+        if (n > 0) {
+            out.rows.push_back(row_offset + row);
+            out.row_ptr.push_back(out.row_ptr.back() + n);
+        }
+    });
+}
+
+// Numeric pass: fills storage preallocated from `structure`, which also fixes
+// the row numbers. A row cut by the range yields a partial row.
+inline void numeric_nnz_range(const CSR& A, const CSR& B, int nnz_begin, int nnz_end, AdaptiveAccumulator& adaptive,
+                              const RangeStructure& structure, RowBlock& out) {
+    out.rows = structure.rows;
+    out.row_ptr = structure.row_ptr;
+    out.cols.resize(structure.row_ptr.back());
+    out.vals.resize(structure.row_ptr.back());
+
+    size_t r = 0;
+    for_each_row_in_range(A, nnz_begin, nnz_end, [&](int, int lo, int hi) {
+        long long flops = range_flops(A, B, lo, hi);
+        if (flops == 0) return;
+        adaptive.visit(flops, true, [&](auto& acc) {
+            for (int e = lo; e < hi; e++) {
+                int k = A.col[e];
+                if (k < 0 || k >= B.rows) continue;
+                value_t a_val = A.val[e];
+                for (int b = B.row_ptr[k]; b < B.row_ptr[k + 1]; b++) acc.add(B.col[b], a_val * B.val[b]);
+            }
+            if (!acc.empty()) {
+                acc.flush_into(&out.cols[out.row_ptr[r]], &out.vals[out.row_ptr[r]]);
+                r++;
+            }
+        });
+    });
+}
+
+// Drops entries that summed to zero, and rows left with none, in place
+inline void compact_zeros(RowBlock& block) {
+    size_t write = 0, kept_rows = 0;
+    int row_begin = 0;
+    for (size_t r = 0; r < block.rows.size(); r++) {
+        size_t row_start = write;
+        int row_end = block.row_ptr[r + 1];
+        for (int e = row_begin; e < row_end; e++) {
+            if (block.vals[e] != 0) {
+                block.cols[write] = block.cols[e];
+                block.vals[write++] = block.vals[e];
+            }
+        }
+        if (write > row_start) {
+            block.rows[kept_rows] = block.rows[r];
+            block.row_ptr[++kept_rows] = write;
+        }
+        row_begin = row_end;
+    }
+    block.rows.resize(kept_rows);
+    block.row_ptr.resize(kept_rows + 1);
+    block.cols.resize(write);
+    block.vals.resize(write);
+}
+
+// Largest number of partial products any single row in the range produces
+inline long long max_row_flops(const CSR& A, const CSR& B, int nnz_begin, int nnz_end) {
+    long long best = 0;
+    for_each_row_in_range(A, nnz_begin, nnz_end,
+                          [&](int, int lo, int hi) { best = std::max(best, range_flops(A, B, lo, hi)); });
+    return best;
+}
+
+// Folds a column-sorted partial row into `out`, merging it with the last row
+// when that is the same row. Entries that cancel to zero are dropped.
+inline void fold_partial_row(RowBlock& out, int row, const int* cols, const value_t* vals, int len) {
+    std::vector<int> own_cols;
+    std::vector<value_t> own_vals;
+    if (!out.rows.empty() && out.rows.back() == row) {
+        int begin = out.row_ptr[out.rows.size() - 1];
+        own_cols.assign(out.cols.begin() + begin, out.cols.end());
+        own_vals.assign(out.vals.begin() + begin, out.vals.end());
+        out.cols.resize(begin);
+        out.vals.resize(begin);
+        out.rows.pop_back();
+        out.row_ptr.pop_back();
+    }
+
+    size_t i = 0, j = 0;
+    while (i < own_cols.size() || j < (size_t)len) {
+        int c;
+        value_t v;
+        if (j == (size_t)len || (i < own_cols.size() && own_cols[i] < cols[j])) {
+            c = own_cols[i]; v = own_vals[i++];
+        } else if (i == own_cols.size() || cols[j] < own_cols[i]) {
+            c = cols[j]; v = vals[j++];
+        } else {
+            c = cols[j]; v = own_vals[i++] + vals[j++];
+        }
+        if (v != 0) {
+            out.cols.push_back(c);
+            out.vals.push_back(v);
+        }
+    }
+    if ((int)out.cols.size() > out.row_ptr.back()) {
+        out.rows.push_back(row);
+        out.row_ptr.push_back(out.cols.size());
+    }
+}
+
+// Work units handed to the thread pool per thread; more units smooth out the
+// tail of dynamic scheduling at the cost of a few more row merges.
+const int CHUNKS_PER_THREAD = 16;
+
+// Per-thread accounting of one threaded multiply, plus how many output rows
+// each accumulator path produced across all threads
+struct ThreadStats {
+    std::vector<double> busy_seconds;
+    std::vector<long long> flops;
+    long long dense_rows = 0, hash_rows = 0;
+
+    // Slowest thread over the average one; 1.0 means perfectly even
+    double imbalance() const {
+        double total = 0, slowest = 0;
+        for (double t : busy_seconds) {
+            total += t;
+            slowest = std::max(slowest, t);
+        }
+        return total > 0 ? slowest * busy_seconds.size() / total : 1.0;
+    }
+};
+
+// Cuts [nnz_begin, nnz_end) into ranges of roughly equal flops. Ranges may
+// split a heavy row, so one dense row still spreads across several threads.
+inline std::vector<int> flop_balanced_chunks(const CSR& A, const CSR& B, int nnz_begin, int nnz_end, int chunks) {
+    // Each entry costs its B row length, plus one so empty B rows are not free
+    long long total = 0;
+    for (int e = nnz_begin; e < nnz_end; e++) {
+        int k = A.col[e];
+        total += 1 + ((k >= 0 && k < B.rows) ? B.row_ptr[k + 1] - B.row_ptr[k] : 0);
+    }
+    long long target = std::max(1LL, total / std::max(chunks, 1));
+
+    std::vector<int> bounds{nnz_begin};
+    long long acc = 0;
+    for (int e = nnz_begin; e < nnz_end; e++) {
+        int k = A.col[e];
+        acc += 1 + ((k >= 0 && k < B.rows) ? B.row_ptr[k + 1] - B.row_ptr[k] : 0);
+        if (acc >= target && e + 1 < nnz_end) {
+            bounds.push_back(e + 1);
+            acc = 0;
+        }
+    }
+    bounds.push_back(nnz_end);
+    return bounds;
+}
+
+// Runs fn(chunk, accumulator) for every chunk [bounds[c], bounds[c + 1]) on
+// `threads` threads. Threads claim chunks from an atomic counter, each with
+// its own adaptive accumulator for P. Busy time and path counters add up in
+// `stats` across calls; `count` also adds each chunk's partial products to
+// the flop counters, so a multiply counts them in one pass only.
+template <class Fn>
+void run_chunks(const CSR& A, const CSR& B, int P, const std::vector<int>& bounds, int threads, bool count,
+                ThreadStats* stats, Fn fn) {
+    using clock = std::chrono::steady_clock;
+    int num_chunks = bounds.size() - 1;
+    // Only rows below the dense threshold reach the hash table
+    long long dense_from = dense_threshold(P);
+    long long hash_size = std::min(max_row_flops(A, B, bounds.front(), bounds.back()), dense_from);
+    std::atomic<int> next_chunk(0);
+    std::atomic<long long> dense_rows(0), hash_rows(0);
+
+    auto worker = [&](int t) {
+        auto start = clock::now();
+        long long done = 0;
+        AdaptiveAccumulator acc(P, dense_from, hash_size);
+        for (int c = next_chunk++; c < num_chunks; c = next_chunk++) {
+            fn(c, acc);
+            if (count) done += range_flops(A, B, bounds[c], bounds[c + 1]);
+        }
+        dense_rows += acc.dense_rows;
+        hash_rows += acc.hash_rows;
+        if (stats) {
+            stats->busy_seconds[t] += std::chrono::duration<double>(clock::now() - start).count();
+            stats->flops[t] += done;
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) pool.emplace_back(worker, t);
+    worker(0);
+    for (auto& th : pool) th.join();
+    if (stats) {
+        stats->dense_rows += dense_rows;
+        stats->hash_rows += hash_rows;
+    }
+}
+
+// Multiplies the A non-zeros in [nnz_begin, nnz_end) against B on `threads`
+// threads sharing A and B read-only, in a symbolic then a numeric pass over
+// flop-balanced chunks. Chunk results are stitched in order, merging rows cut
+// at chunk boundaries.
+inline RowBlock multiply(const CSR& A, const CSR& B, int P, int nnz_begin, int nnz_end, int row_offset,
+                         int threads = 1, ThreadStats* stats = nullptr) {
+    threads = std::max(threads, 1);
+    if (stats) {
+        *stats = ThreadStats();
+        stats->busy_seconds.assign(threads, 0.0);
+        stats->flops.assign(threads, 0);
+    }
+
+    std::vector<int> bounds = (threads == 1) ? std::vector<int>{nnz_begin, nnz_end}
+                                             : flop_balanced_chunks(A, B, nnz_begin, nnz_end, threads * CHUNKS_PER_THREAD);
+    int num_chunks = bounds.size() - 1;
+
+    std::vector<RangeStructure> chunks(num_chunks);
+    run_chunks(A, B, P, bounds, threads, false, stats, [&](int c, auto& acc) {
+        symbolic_nnz_range(A, B, bounds[c], bounds[c + 1], row_offset, acc, chunks[c]);
+    });
+
+    std::vector<RowBlock> parts(num_chunks);
+    run_chunks(A, B, P, bounds, threads, true, stats, [&](int c, auto& acc) {
+        numeric_nnz_range(A, B, bounds[c], bounds[c + 1], acc, chunks[c], parts[c]);
+    });
+
+    if (num_chunks == 1) {
+        compact_zeros(parts[0]);
+        return std::move(parts[0]);
+    }
+
+    RowBlock out;
+    size_t total = 0;
+    for (const RowBlock& part : parts) total += part.cols.size();
+    out.cols.reserve(total);
+    out.vals.reserve(total);
+    for (const RowBlock& part : parts) {
+        for (size_t r = 0; r < part.rows.size(); r++) {
+            int begin = part.row_ptr[r];
+            fold_partial_row(out, part.rows[r], part.cols.data() + begin, part.vals.data() + begin,
+                             part.row_ptr[r + 1] - begin);
+        }
+    }
+    return out;
+}
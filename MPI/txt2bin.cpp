@@ -0,0 +1,142 @@
+// Converts q1's text matrices to the binary CSR format in csr_bin.h and back.
+//
+//   ./txt2bin input.txt input.bin        text "N M P" + A rows + B rows -> binary
+//   ./txt2bin --to-text file.bin         binary (input or q1 product) -> text on stdout
+#include "csr_bin.h"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Buffered integer reader, much faster than cin >> on large inputs
+struct IntReader {
+    FILE* f;
+    vector<char> buf = vector<char>(1 << 20);
+    size_t pos = 0, len = 0;
+
+    explicit IntReader(FILE* file) : f(file) {}
+
+    int next_char() {
+        if (pos == len) {
+            len = fread(buf.data(), 1, buf.size(), f);
+            pos = 0;
+            if (len == 0) return -1;
+        }
+        return buf[pos++];
+    }
+
+    bool read(long long& out) {
+        int c = next_char();
+        while (c != -1 && c != '-' && (c < '0' || c > '9')) c = next_char();
+        if (c == -1) return false;
+        bool neg = (c == '-');
+        if (neg) c = next_char();
+        long long v = 0;
+        for (; c >= '0' && c <= '9'; c = next_char()) v = v * 10 + (c - '0');
+        out = neg ? -v : v;
+        return true;
+    }
+};
+
+void die(const string& msg) {
+    cerr << "Error: " << msg << endl;
+    exit(1);
+}
+
+long long read_int(IntReader& in) {
+    long long v;
+    if (!in.read(v)) die("unexpected end of input");
+    return v;
+}
+
+// Parses one matrix of `rows` text rows and appends its sections at the
+// current position of `out`; only this matrix is ever held in memory.
+CsrBinMatrix convert_matrix(IntReader& in, FILE* out, long long rows, long long cols) {
+    vector<int64_t> row_ptr(rows + 1, 0);
+    vector<int32_t> col, val;
+    for (long long i = 0; i < rows; i++) {
+        long long k = read_int(in);
+        row_ptr[i + 1] = row_ptr[i] + k;
+        for (long long j = 0; j < k; j++) {
+            col.push_back(read_int(in));
+            val.push_back(read_int(in));
+        }
+    }
+    fwrite(row_ptr.data(), sizeof(int64_t), row_ptr.size(), out);
+    fwrite(col.data(), sizeof(int32_t), col.size(), out);
+    fwrite(val.data(), sizeof(int32_t), val.size(), out);
+
+    CsrBinMatrix m = {rows, cols, (int64_t)col.size(), (int32_t)sizeof(int32_t), 0};
+    return m;
+}
+
+int text_to_binary(const char* in_path, const char* out_path) {
+    FILE* in_file = fopen(in_path, "rb");
+    if (!in_file) die(string("could not open ") + in_path);
+    FILE* out = fopen(out_path, "wb");
+    if (!out) die(string("could not create ") + out_path);
+
+    IntReader in(in_file);
+    long long N = read_int(in), M = read_int(in), P = read_int(in);
+
+    // Descriptors are rewritten once both nnz counts are known
+    CsrBinHeader header = make_csr_bin_header(2);
+    vector<CsrBinMatrix> mats(2);
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(mats.data(), sizeof(CsrBinMatrix), mats.size(), out);
+
+    mats[0] = convert_matrix(in, out, N, M);
+    mats[1] = convert_matrix(in, out, M, P);
+
+    fseek(out, sizeof(header), SEEK_SET);
+    fwrite(mats.data(), sizeof(CsrBinMatrix), mats.size(), out);
+    fclose(out);
+    fclose(in_file);
+    return 0;
+}
+
+int binary_to_text(const char* in_path) {
+    FILE* in = fopen(in_path, "rb");
+    if (!in) die(string("could not open ") + in_path);
+
+    CsrBinHeader header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || !csr_bin_header_ok(header)) die("not a binary CSR file");
+    vector<CsrBinMatrix> mats(header.num_matrices);
+    if (fread(mats.data(), sizeof(CsrBinMatrix), mats.size(), in) != mats.size()) die("truncated header");
+
+    // A/B inputs carry the "N M P" line; products are printed the way q1 prints them
+    if (mats.size() == 2) printf("%lld %lld %lld\n", (long long)mats[0].rows, (long long)mats[0].cols, (long long)mats[1].cols);
+
+    for (const CsrBinMatrix& m : mats) {
+        vector<int64_t> row_ptr(m.rows + 1);
+        vector<int32_t> col(m.nnz);
+        vector<char> val(m.nnz * m.value_bytes);
+        if (fread(row_ptr.data(), sizeof(int64_t), row_ptr.size(), in) != row_ptr.size() ||
+            fread(col.data(), sizeof(int32_t), col.size(), in) != col.size() ||
+            fread(val.data(), 1, val.size(), in) != val.size()) {
+            die("truncated matrix data");
+        }
+        for (int64_t i = 0; i < m.rows; i++) {
+            printf("%lld", (long long)(row_ptr[i + 1] - row_ptr[i]));
+            for (int64_t e = row_ptr[i]; e < row_ptr[i + 1]; e++) {
+                long long v = (m.value_bytes == 8) ? ((const int64_t*)val.data())[e] : ((const int32_t*)val.data())[e];
+                printf(" %d %lld", col[e], v);
+            }
+            printf("\n");
+        }
+    }
+    fclose(in);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 3 && string(argv[1]) == "--to-text") return binary_to_text(argv[2]);
+    if (argc == 3) return text_to_binary(argv[1], argv[2]);
+
+    cerr << "Usage: " << argv[0] << " <input.txt> <output.bin>" << endl;
+    cerr << "       " << argv[0] << " --to-text <file.bin>" << endl;
+    return 1;
+}
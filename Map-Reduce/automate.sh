@@ -13,7 +13,7 @@ mkdir -p outputs benchmark testcases
 
 # Compile and run generate.cpp once
 echo "Compiling generate.cpp..."
-g++ -O2 -std=c++17 generate.cpp -o generate
+g++ -O2 -std=c++17 -pthread generate.cpp -o generate
 if [ $? -ne 0 ]; then
     echo "Compilation failed!"
     exit 1
@@ -1,54 +1,515 @@
+// Synthetic inputs for q2 (edge lists) and q1 (sparse matrix pairs).
+//
+//   ./generate                         random small G(n, m) graph -> input.txt (the old behaviour)
+//   ./generate er N M                  G(n, m): M distinct edges over vertices 1..N
+//   ./generate rmat SCALE M            R-MAT power-law graph on 2^SCALE vertices, M edges
+//   ./generate band N M P              q1 input: banded A (N x M) and B (M x P)
+//
+// Options:
+//   --out=FILE        output path (default input.txt)
+//   --seed=S          base seed (default 1)
+//   --threads=T       worker threads (default: all cores)
+//   --chunk=K         edges (graphs) or rows (matrices) per chunk
+//   --part=I/K        write only slice I of K of the chunks, for running on many
+//                     ranks or hosts; text goes to FILE.partI, to be concatenated
+//                     in order; binary parts all write into FILE
+//   --rmat=A,B,C      R-MAT quadrant probabilities (default 0.57,0.19,0.19)
+//   --band=W          band half-width in columns (default 8)
+//   --block=W         block-diagonal blocks of W columns instead of a band
+//   --density=D       fraction of the band or block filled (default 0.5)
+//   --binary          matrices: write the binary CSR format of MPI/csr_bin.h
+//   --multigraph      rmat: stream chunks as drawn, allowing repeats across chunks
+//
+// Output is streamed chunk by chunk and never held whole. Every chunk (and,
+// for matrices, every row) draws from its own generator seeded from (seed,
+// chunk), so the output is the same for any thread count or part split.
+// Graph files start with an "n m" line (q2 --header skips it); edges are u < v. Within an
+// er chunk edges are distinct and sorted, and chunks cover disjoint pair
+// ranges, so G(n, m) graphs are simple. R-MAT chunks can draw the same edge,
+// so R-MAT holds the whole edge set (8 bytes an edge) to drop repeats and
+// writes it sorted; --multigraph streams the chunks instead, repeats and all.
 #include <bits/stdc++.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../MPI/csr_bin.h"
 using namespace std;
 
-int main() {
-  int inf=500;
-    ios::sync_with_stdio(false);
-    cin.tie(nullptr);
+struct Options {
+    string out = "input.txt";
+    uint64_t seed = 1;
+    int threads = max(1u, thread::hardware_concurrency());
+    long long chunk = 0;
+    int part = 0, parts = 1;
+    double a = 0.57, b = 0.19, c = 0.19;
+    long long width = 8;
+    bool block = false, binary = false, multigraph = false;
+    double density = 0.5;
+};
 
-    // Random seed
-    random_device rd;
-    mt19937 gen(rd());
+// --- Seeding and random numbers ---
+inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
 
-    // Choose n and m randomly
-    uniform_int_distribution<int> distN(50, 600);   // change range as needed
-    int n = distN(gen);
-    long long maxi=(long)(n);
-	maxi*=n;
-	maxi*=n;
-
-    // Max edges possible in undirected graph with n nodes
-    int maxEdges = n * (n - 1) / 2;
-    int  tot=powl(10,9);
-    tot/=n;
-   maxEdges=min((int)maxEdges,(int)tot);
-    long long two=maxEdges;
-    uniform_int_distribution<int> distM(n-1, maxEdges);
-    int m = distM(gen);
+// Generator for one chunk or row: splitmix64 over a seed mixed from the keys
+struct Rng {
+    uint64_t state;
+    Rng(uint64_t seed, uint64_t stream, uint64_t index)
+        : state(splitmix64(splitmix64(seed ^ splitmix64(stream)) ^ index)) {}
+    uint64_t next() { return splitmix64(state++); }
+    // Uniform in [0, n)
+    uint64_t below(uint64_t n) { return (uint64_t)(((unsigned __int128)next() * n) >> 64); }
+    double uniform() { return (next() >> 11) * 0x1.0p-53; }
+};
 
-    cout << "n = " << n << ", m = " << m << "\n";
+void die(const string& msg) {
+    cerr << "Error: " << msg << endl;
+    exit(1);
+}
+
+// --- Output ---
+struct TextBuffer {
+    string s;
+    void num(long long v) {
+        char tmp[24];
+        auto res = to_chars(tmp, tmp + sizeof(tmp), v);
+        s.append(tmp, res.ptr);
+    }
+    void ch(char c) { s.push_back(c); }
+};
+
+// Runs make(chunk, buffer) for chunks [lo, hi) on all threads, a wave of
+// `threads` chunks at a time, and writes the buffers to `out` in chunk order
+void run_chunks(long long lo, long long hi, int threads, FILE* out, const function<void(long long, TextBuffer&)>& make) {
+    vector<TextBuffer> wave(threads);
+    for (long long first = lo; first < hi; first += threads) {
+        int n = min<long long>(threads, hi - first);
+        vector<thread> pool;
+        for (int t = 0; t < n; t++) {
+            pool.emplace_back([&, t] {
+                wave[t].s.clear();
+                make(first + t, wave[t]);
+            });
+        }
+        for (auto& th : pool) th.join();
+        for (int t = 0; t < n; t++) {
+            if (fwrite(wave[t].s.data(), 1, wave[t].s.size(), out) != wave[t].s.size()) die("write failed");
+        }
+    }
+}
+
+// This part's slice of `chunks`
+pair<long long, long long> part_range(long long chunks, const Options& opt) {
+    return {chunks * opt.part / opt.parts, chunks * (opt.part + 1) / opt.parts};
+}
+
+FILE* open_text_output(const Options& opt) {
+    string path = opt.parts > 1 ? opt.out + ".part" + to_string(opt.part) : opt.out;
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) die("could not create " + path);
+    return out;
+}
+
+// --- G(n, m) ---
+// The n(n-1)/2 vertex pairs are numbered row by row (u < v). Chunk c owns an
+// equal slice of that numbering and an equal share of the m edges, and draws
+// its share as distinct indices in its slice: plain draws, sort and unique,
+// redraw the shortfall; when the share is over half the slice it draws the
+// pairs to leave out instead.
+inline pair<long long, long long> pair_at(long long n, long long k) {
+    long double b = 2.0L * n - 1;
+    long long u = (long long)((b - sqrtl(b * b - 8.0L * k)) / 2);
+    auto start = [&](long long r) { return r * (2 * n - r - 1) / 2; };
+    while (u > 0 && start(u) > k) u--;
+    while (start(u + 1) <= k) u++;
+    return {u, u + 1 + (k - start(u))};
+}
 
-    set<pair<int,int>> edges;
+vector<long long> distinct_in_range(Rng& rng, long long lo, long long len, long long want) {
+    bool invert = want > len / 2;
+    long long draw = invert ? len - want : want;
+    vector<long long> picked;
+    while ((long long)picked.size() < draw) {
+        for (long long i = picked.size(); i < draw; i++) picked.push_back(lo + rng.below(len));
+        sort(picked.begin(), picked.end());
+        picked.erase(unique(picked.begin(), picked.end()), picked.end());
+    }
+    if (!invert) return picked;
+    vector<long long> kept;
+    kept.reserve(want);
+    size_t j = 0;
+    for (long long k = lo; k < lo + len; k++) {
+        if (j < picked.size() && picked[j] == k) j++;
+        else kept.push_back(k);
+    }
+    return kept;
+}
 
-    uniform_int_distribution<int> distNode(1, n);
+void generate_er(long long n, long long m, const Options& opt) {
+    long long pairs = n * (n - 1) / 2;
+    if (n < 2 || m < 0 || m > pairs) die("G(n, m) needs n >= 2 and 0 <= m <= n(n-1)/2");
+    long long per_chunk = opt.chunk > 0 ? opt.chunk : 1 << 20;
+    long long chunks = max(1LL, (m + per_chunk - 1) / per_chunk);
+    FILE* out = open_text_output(opt);
+    if (opt.part == 0) fprintf(out, "%lld %lld\n", n, m);
+    auto [lo, hi] = part_range(chunks, opt);
+    run_chunks(lo, hi, opt.threads, out, [&](long long c, TextBuffer& buf) {
+        long long begin = (long long)((__int128)pairs * c / chunks), end = (long long)((__int128)pairs * (c + 1) / chunks);
+        long long want = (long long)((__int128)m * (c + 1) / chunks - (__int128)m * c / chunks);
+        Rng rng(opt.seed, 1, c);
+        for (long long k : distinct_in_range(rng, begin, end - begin, want)) {
+            auto [u, v] = pair_at(n, k);
+            buf.num(u + 1);
+            buf.ch(' ');
+            buf.num(v + 1);
+            buf.ch('\n');
+        }
+    });
+    fclose(out);
+}
 
-    // Generate unique edges
-    while ((int)edges.size() < m) {
-        int u = distNode(gen);
-        int v = distNode(gen);
-        if (u == v) continue;
-        if (u > v) swap(u, v);
-        edges.insert({u, v});
+// --- R-MAT ---
+// Each edge picks one quadrant of the adjacency matrix per level with
+// probabilities a, b, c, d; self loops and repeats are redrawn (only those
+// inside the chunk with --multigraph). Vertex ids are then scrambled by a seeded bijection of
+// [0, 2^scale) so the hubs do not sit at the low ids. Skewed probabilities
+// make most pairs very unlikely, so a request close to n(n-1)/2 edges may
+// never fill up; redraws are bounded and such a request fails instead of
+// hanging.
+struct Scramble {
+    int scale;
+    uint64_t mask, mul1, mul2;
+    Scramble(int scale, uint64_t seed)
+        : scale(scale), mask(scale >= 64 ? ~0ULL : (1ULL << scale) - 1),
+          mul1(splitmix64(seed ^ 0x5ca1ab1eULL) | 1), mul2(splitmix64(seed ^ 0xdeadbeefULL) | 1) {}
+    uint64_t operator()(uint64_t x) const {
+        int shift = max(1, scale / 2);
+        x = (x * mul1) & mask;
+        x ^= x >> shift;
+        x = (x * mul2) & mask;
+        x ^= x >> shift;
+        return x;
     }
+};
+
+const long long RMAT_DRAWS_PER_EDGE = 64;
 
-    // Write edges to file
-    ofstream fout("input.txt");
-      fout<<n<<' '<<m<<endl;
-    for (auto &e : edges) {
-        fout << e.first << " " << e.second << "\n";
+void die_rmat_too_dense(int scale, long long m) {
+    die("R-MAT at scale " + to_string(scale) + " did not reach " + to_string(m) +
+        " distinct edges within its redraw budget; ask for fewer edges");
+}
+
+// `want` distinct edges packed as u << 32 | v (u < v), sorted
+vector<uint64_t> rmat_edges(int scale, long long want, Rng& rng, const Scramble& scramble, const Options& opt) {
+    double ab = opt.a + opt.b, abc = ab + opt.c;
+    long long draws = 0, max_draws = RMAT_DRAWS_PER_EDGE * want + 1024;
+    vector<uint64_t> edges;
+    while ((long long)edges.size() < want) {
+        while ((long long)edges.size() < want) {
+            if (++draws > max_draws) die_rmat_too_dense(scale, want);
+            uint64_t u = 0, v = 0;
+            for (int level = 0; level < scale; level++) {
+                double r = rng.uniform();
+                u = u << 1 | (r >= ab);
+                v = v << 1 | ((r >= opt.a && r < ab) || r >= abc);
+            }
+            u = scramble(u);
+            v = scramble(v);
+            if (u == v) continue;
+            edges.push_back(min(u, v) << 32 | max(u, v));
+        }
+        sort(edges.begin(), edges.end());
+        edges.erase(unique(edges.begin(), edges.end()), edges.end());
+    }
+    return edges;
+}
+
+void write_edges(TextBuffer& buf, const uint64_t* begin, const uint64_t* end) {
+    for (const uint64_t* e = begin; e != end; e++) {
+        buf.num((long long)(*e >> 32) + 1);
+        buf.ch(' ');
+        buf.num((long long)(*e & 0xffffffffu) + 1);
+        buf.ch('\n');
+    }
+}
+
+void generate_rmat(int scale, long long m, const Options& opt) {
+    if (scale < 1 || scale > 31) die("R-MAT scale must be in 1..31");
+    long long n = 1LL << scale;
+    if (m < 0 || m > n * (n - 1) / 2) die("too many edges for this scale");
+    if (opt.a < 0 || opt.b < 0 || opt.c < 0 || opt.a + opt.b + opt.c > 1) die("R-MAT probabilities must be >= 0 with a + b + c <= 1");
+    // Only the b and c quadrants put u and v apart; without them every draw is a self loop
+    if (m > 0 && opt.b + opt.c <= 0) die("R-MAT needs b + c > 0, or every edge is a self loop");
+    long long per_chunk = opt.chunk > 0 ? opt.chunk : 1 << 20;
+    long long chunks = max(1LL, (m + per_chunk - 1) / per_chunk);
+    Scramble scramble(scale, opt.seed);
+    auto chunk_edges = [&](long long c) {
+        Rng rng(opt.seed, 2, c);
+        return rmat_edges(scale, m * (c + 1) / chunks - m * c / chunks, rng, scramble, opt);
+    };
+    FILE* out = open_text_output(opt);
+    if (opt.part == 0) fprintf(out, "%lld %lld\n", n, m);
+    auto [lo, hi] = part_range(chunks, opt);
+    if (opt.multigraph) {
+        run_chunks(lo, hi, opt.threads, out, [&](long long c, TextBuffer& buf) {
+            vector<uint64_t> edges = chunk_edges(c);
+            write_edges(buf, edges.data(), edges.data() + edges.size());
+        });
+        fclose(out);
+        return;
+    }
+
+    // Every part draws all chunks, so all parts agree on the edge set; the
+    // shortfall left by repeats is drawn from extra streams until m are
+    // distinct, within the same per-edge redraw budget
+    vector<vector<uint64_t>> drawn(chunks);
+    atomic<long long> next{0};
+    vector<thread> pool;
+    for (int t = 0; t < opt.threads; t++) {
+        pool.emplace_back([&] {
+            for (long long c; (c = next++) < chunks;) drawn[c] = chunk_edges(c);
+        });
+    }
+    for (auto& th : pool) th.join();
+    vector<uint64_t> edges;
+    edges.reserve(m);
+    for (auto& d : drawn) {
+        edges.insert(edges.end(), d.begin(), d.end());
+        vector<uint64_t>().swap(d);
+    }
+    sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+    for (long long round = 0; (long long)edges.size() < m; round++) {
+        if (round == RMAT_DRAWS_PER_EDGE) die_rmat_too_dense(scale, m);
+        Rng rng(opt.seed, 3, round);
+        vector<uint64_t> extra = rmat_edges(scale, m - edges.size(), rng, scramble, opt);
+        size_t mid = edges.size();
+        edges.insert(edges.end(), extra.begin(), extra.end());
+        inplace_merge(edges.begin(), edges.begin() + mid, edges.end());
+        edges.erase(unique(edges.begin(), edges.end()), edges.end());
     }
-    fout.close();
 
-    cout << "Edges written to input.txt\n";
+    // Written sorted, chunk c being the c-th slice of the edge set
+    run_chunks(lo, hi, opt.threads, out, [&](long long c, TextBuffer& buf) {
+        write_edges(buf, edges.data() + m * c / chunks, edges.data() + m * (c + 1) / chunks);
+    });
+    fclose(out);
+}
+
+// --- Banded / block-diagonal matrices for q1 ---
+// Row i of an R x C matrix may use the columns near i * C / R (a band of
+// half-width W), or, with --block, the columns of its diagonal block. Each
+// candidate column is kept with probability `density`; the value (-9..9)
+// comes from the same draw, so a row can be replayed just to count it.
+struct MatrixSpec {
+    long long rows, cols;
+    int id;  // 0 = A, 1 = B: separates the row streams
+};
+
+template <class Emit>
+void matrix_row(const MatrixSpec& mat, long long i, const Options& opt, Emit emit) {
+    long long lo, hi;
+    if (opt.block) {
+        long long blocks = max(1LL, (mat.cols + opt.width - 1) / opt.width);
+        long long blk = (long long)((__int128)i * blocks / mat.rows);
+        lo = blk * opt.width;
+        hi = min(mat.cols, lo + opt.width);
+    } else {
+        long long center = (long long)((__int128)i * mat.cols / mat.rows);
+        lo = max(0LL, center - opt.width);
+        hi = min(mat.cols, center + opt.width + 1);
+    }
+    Rng rng(opt.seed, 3 + mat.id, i);
+    uint64_t threshold = (uint64_t)(opt.density * 0x1.0p64 >= 0x1.0p64 ? ~0ULL : opt.density * 0x1.0p64);
+    for (long long col = lo; col < hi; col++) {
+        uint64_t r = rng.next();
+        if (r < threshold) emit(col, (int)(r % 19) - 9);
+    }
+}
+
+long long row_nnz(const MatrixSpec& mat, long long i, const Options& opt) {
+    long long k = 0;
+    matrix_row(mat, i, opt, [&](long long, int) { k++; });
+    return k;
+}
+
+void write_text_matrices(const vector<MatrixSpec>& mats, const Options& opt) {
+    long long per_chunk = opt.chunk > 0 ? opt.chunk : 1 << 14;
+    FILE* out = open_text_output(opt);
+    // The chunks of A then B form one sequence, so parts split both evenly
+    vector<long long> first_chunk = {0};
+    for (const auto& mat : mats) first_chunk.push_back(first_chunk.back() + (mat.rows + per_chunk - 1) / per_chunk);
+    if (opt.part == 0) fprintf(out, "%lld %lld %lld\n", mats[0].rows, mats[0].cols, mats[1].cols);
+    auto [lo, hi] = part_range(first_chunk.back(), opt);
+    run_chunks(lo, hi, opt.threads, out, [&](long long c, TextBuffer& buf) {
+        int which = c >= first_chunk[1];
+        const MatrixSpec& mat = mats[which];
+        long long begin = (c - first_chunk[which]) * per_chunk, end = min(mat.rows, begin + per_chunk);
+        vector<pair<long long, int>> row;
+        for (long long i = begin; i < end; i++) {
+            row.clear();
+            matrix_row(mat, i, opt, [&](long long col, int v) { row.push_back({col, v}); });
+            buf.num(row.size());
+            for (auto& e : row) {
+                buf.ch(' ');
+                buf.num(e.first);
+                buf.ch(' ');
+                buf.num(e.second);
+            }
+            buf.ch('\n');
+        }
+    });
+    fclose(out);
+}
+
+void pwrite_all(int fd, const void* data, size_t bytes, int64_t offset) {
+    const char* p = (const char*)data;
+    while (bytes > 0) {
+        ssize_t n = pwrite(fd, p, bytes, offset);
+        if (n <= 0) die("write failed");
+        p += n;
+        bytes -= n;
+        offset += n;
+    }
+}
+
+// Binary CSR: one counting pass gives every chunk's nnz and so every
+// section offset; the second pass writes each chunk's row_ptr, col and val
+// slices in place, from any thread or part, into the one file
+void write_binary_matrices(const vector<MatrixSpec>& mats, const Options& opt) {
+    long long per_chunk = opt.chunk > 0 ? opt.chunk : 1 << 14;
+    vector<CsrBinMatrix> desc;
+    vector<vector<long long>> chunk_start(mats.size());  // nnz before each chunk
+    for (const auto& mat : mats) {
+        long long chunks = (mat.rows + per_chunk - 1) / per_chunk;
+        vector<long long> nnz(chunks);
+        vector<thread> pool;
+        atomic<long long> next(0);
+        for (int t = 0; t < opt.threads; t++) {
+            pool.emplace_back([&] {
+                for (long long c; (c = next++) < chunks;) {
+                    long long k = 0;
+                    for (long long i = c * per_chunk; i < min(mat.rows, (c + 1) * per_chunk); i++) k += row_nnz(mat, i, opt);
+                    nnz[c] = k;
+                }
+            });
+        }
+        for (auto& th : pool) th.join();
+        auto& start = chunk_start[desc.size()];
+        start.assign(chunks + 1, 0);
+        for (long long c = 0; c < chunks; c++) start[c + 1] = start[c] + nnz[c];
+        desc.push_back({mat.rows, mat.cols, start.back(), (int32_t)sizeof(int32_t), 0});
+    }
+    vector<CsrBinSections> layout = csr_bin_layout(desc);
+
+    int fd = open(opt.out.c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) die("could not create " + opt.out);
+    if (opt.part == 0) {
+        if (ftruncate(fd, layout.back().end) != 0) die("could not size " + opt.out);
+        CsrBinHeader header = make_csr_bin_header(desc.size());
+        pwrite_all(fd, &header, sizeof(header), 0);
+        pwrite_all(fd, desc.data(), desc.size() * sizeof(CsrBinMatrix), sizeof(header));
+        for (size_t m = 0; m < mats.size(); m++) {
+            int64_t total = desc[m].nnz;
+            pwrite_all(fd, &total, sizeof(total), layout[m].row_ptr + mats[m].rows * (int64_t)sizeof(int64_t));
+        }
+    }
+
+    vector<pair<int, long long>> work;  // (matrix, chunk)
+    for (size_t m = 0; m < mats.size(); m++) {
+        for (long long c = 0; c + 1 < (long long)chunk_start[m].size(); c++) work.push_back({(int)m, c});
+    }
+    auto [lo, hi] = part_range(work.size(), opt);
+    atomic<long long> next(lo);
+    vector<thread> pool;
+    for (int t = 0; t < opt.threads; t++) {
+        pool.emplace_back([&] {
+            vector<int64_t> row_ptr;
+            vector<int32_t> col, val;
+            for (long long w; (w = next++) < hi;) {
+                auto [m, c] = work[w];
+                const MatrixSpec& mat = mats[m];
+                long long begin = c * per_chunk, end = min(mat.rows, begin + per_chunk);
+                int64_t base = chunk_start[m][c];
+                row_ptr.clear();
+                col.clear();
+                val.clear();
+                for (long long i = begin; i < end; i++) {
+                    row_ptr.push_back(base + col.size());
+                    matrix_row(mat, i, opt, [&](long long cc, int v) {
+                        col.push_back(cc);
+                        val.push_back(v);
+                    });
+                }
+                pwrite_all(fd, row_ptr.data(), row_ptr.size() * sizeof(int64_t), layout[m].row_ptr + begin * (int64_t)sizeof(int64_t));
+                pwrite_all(fd, col.data(), col.size() * sizeof(int32_t), layout[m].col + base * (int64_t)sizeof(int32_t));
+                pwrite_all(fd, val.data(), val.size() * sizeof(int32_t), layout[m].val + base * (int64_t)sizeof(int32_t));
+            }
+        });
+    }
+    for (auto& th : pool) th.join();
+    close(fd);
+}
+
+void generate_band(long long n, long long m, long long p, const Options& opt) {
+    if (n < 1 || m < 1 || p < 1 || m > INT32_MAX || p > INT32_MAX) die("matrix sizes must be positive (columns below 2^31)");
+    if (opt.width < 1 || opt.density < 0 || opt.density > 1) die("need --band/--block >= 1 and 0 <= --density <= 1");
+    vector<MatrixSpec> mats = {{n, m, 0}, {m, p, 1}};
+    if (opt.binary) write_binary_matrices(mats, opt);
+    else write_text_matrices(mats, opt);
+}
+
+// The original generator: a random G(n, m) with n in 50..600, m in
+// [n - 1, min(n(n-1)/2, 1e9 / n)], written to input.txt
+void generate_default(Options opt) {
+    random_device rd;
+    mt19937 gen(rd());
+    uniform_int_distribution<int> distN(50, 600);
+    long long n = distN(gen);
+    long long maxEdges = min(n * (n - 1) / 2, 1000000000LL / n);
+    uniform_int_distribution<long long> distM(n - 1, maxEdges);
+    long long m = distM(gen);
+    cout << "n = " << n << ", m = " << m << "\n";
+    opt.seed = gen();
+    generate_er(n, m, opt);
+    cout << "Edges written to " << opt.out << "\n";
+}
+
+int main(int argc, char** argv) {
+    ios::sync_with_stdio(false);
+    Options opt;
+    vector<string> args;
+    for (int i = 1; i < argc; i++) {
+        string s = argv[i];
+        if (s.rfind("--out=", 0) == 0) opt.out = s.substr(6);
+        else if (s.rfind("--seed=", 0) == 0) opt.seed = stoull(s.substr(7));
+        else if (s.rfind("--threads=", 0) == 0) opt.threads = max(1, stoi(s.substr(10)));
+        else if (s.rfind("--chunk=", 0) == 0) opt.chunk = max(1LL, stoll(s.substr(8)));
+        else if (s.rfind("--part=", 0) == 0) {
+            if (sscanf(s.c_str() + 7, "%d/%d", &opt.part, &opt.parts) != 2 || opt.parts < 1 || opt.part < 0 || opt.part >= opt.parts) die("--part needs I/K with 0 <= I < K");
+        } else if (s.rfind("--rmat=", 0) == 0) {
+            if (sscanf(s.c_str() + 7, "%lf,%lf,%lf", &opt.a, &opt.b, &opt.c) != 3) die("--rmat needs A,B,C");
+        } else if (s.rfind("--band=", 0) == 0) opt.width = stoll(s.substr(7));
+        else if (s.rfind("--block=", 0) == 0) {
+            opt.width = stoll(s.substr(8));
+            opt.block = true;
+        } else if (s.rfind("--density=", 0) == 0) opt.density = stod(s.substr(10));
+        else if (s == "--binary") opt.binary = true;
+        else if (s == "--multigraph") opt.multigraph = true;
+        else if (s.rfind("--", 0) == 0) die("unknown option " + s);
+        else args.push_back(s);
+    }
+
+    if (args.empty()) generate_default(opt);
+    else if (args[0] == "er" && args.size() == 3) generate_er(stoll(args[1]), stoll(args[2]), opt);
+    else if (args[0] == "rmat" && args.size() == 3) generate_rmat(stoi(args[1]), stoll(args[2]), opt);
+    else if (args[0] == "band" && args.size() == 4) generate_band(stoll(args[1]), stoll(args[2]), stoll(args[3]), opt);
+    else {
+        cerr << "Usage: " << argv[0] << " [er N M | rmat SCALE M | band N M P] [options]" << endl;
+        return 1;
+    }
     return 0;
 }
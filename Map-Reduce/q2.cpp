@@ -4,199 +4,1843 @@
 #include <sstream>
 #include <map>
 #include <algorithm>
+#include <array>
 #include <utility>
 #include <fstream>
 #include <functional> // For hash
+#include <limits>
+#include <cstring>
+#include <cstdint>
+#include <cctype>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <queue>
 #include <mpi.h>
+#include "../common/mpi_profile.h"
+#include "../common/wire_codec.h"
 using namespace std;
 // Using custom types for clarity
 using vertex_t = int;
 using count_t = long long;
 using edge_t = pair<vertex_t, vertex_t>;
-using wedge_t = pair<edge_t, vertex_t>;
 using pvc_pair_t = pair<vertex_t, count_t>; // For Per-Vertex Counts
 
+// A wedge v1 - center - v2 with its endpoints packed as v1 << 32 | v2 (v1 < v2),
+// so wedges on the same endpoint pair group by sorting a single integer key.
+// Packed to 12 bytes, the same size on the wire as the old nested pairs.
+#pragma pack(push, 4)
+struct wedge_t
+{
+    uint64_t key;
+    vertex_t center;
+};
+#pragma pack(pop)
+
+inline uint64_t pair_key(vertex_t v1, vertex_t v2)
+{
+    return (uint64_t)(uint32_t)v1 << 32 | (uint32_t)v2;
+}
+
+// --- Node-shared arrays ---
+// The per-vertex arrays (degrees, center owners, cycle counts) are kept once
+// per node in an MPI_Win_allocate_shared segment rather than once per rank,
+// so a node's memory grows with the graph, not with ranks x graph. Ranks on
+// a node add into the segment with atomics; sync() orders the phases, and
+// sum_across_nodes() combines the node copies through the node leaders.
+struct NodeComms
+{
+    MPI_Comm node = MPI_COMM_NULL;    // ranks sharing memory
+    MPI_Comm leaders = MPI_COMM_NULL; // node rank 0 of every node, else null
+    int node_rank = 0, node_size = 1;
+};
+
+NodeComms make_node_comms(int rank)
+{
+    NodeComms nc;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &nc.node);
+    MPI_Comm_rank(nc.node, &nc.node_rank);
+    MPI_Comm_size(nc.node, &nc.node_size);
+    MPI_Comm_split(MPI_COMM_WORLD, nc.node_rank == 0 ? 0 : MPI_UNDEFINED, rank, &nc.leaders);
+    return nc;
+}
+
+template <class T>
+MPI_Datatype mpi_type();
+template <>
+inline MPI_Datatype mpi_type<int>() { return MPI_INT; }
+template <>
+inline MPI_Datatype mpi_type<long long>() { return MPI_LONG_LONG; }
+
+template <class T>
+struct NodeArray
+{
+    const NodeComms *nc = nullptr;
+    MPI_Win win = MPI_WIN_NULL;
+    T *ptr = nullptr;
+    size_t n = 0;
+
+    NodeArray() = default;
+    NodeArray(const NodeArray &) = delete;
+    NodeArray &operator=(const NodeArray &) = delete;
+    NodeArray(NodeArray &&other) { *this = move(other); }
+    NodeArray &operator=(NodeArray &&other)
+    {
+        swap(nc, other.nc);
+        swap(win, other.win);
+        swap(ptr, other.ptr);
+        swap(n, other.n);
+        return *this;
+    }
+    ~NodeArray()
+    {
+        // Arrays in main's scope outlive MPI_Finalize and go with it
+        int finalized;
+        MPI_Finalized(&finalized);
+        if (!finalized)
+            release();
+    }
+
+    // Collective on the node: `count` zeroed elements, or the old contents
+    // followed by zeros when growing
+    void allocate(size_t count, const NodeComms &comms)
+    {
+        if (win != MPI_WIN_NULL)
+            sync();
+        nc = &comms;
+        MPI_Win fresh;
+        T *base;
+        MPI_Aint bytes = nc->node_rank == 0 ? max<size_t>(count, 1) * sizeof(T) : 0;
+        MPI_Win_allocate_shared(bytes, sizeof(T), MPI_INFO_NULL, nc->node, &base, &fresh);
+        MPI_Aint size;
+        int unit;
+        MPI_Win_shared_query(fresh, 0, &size, &unit, &base);
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, fresh);
+        if (nc->node_rank == 0)
+        {
+            size_t keep = min(n, count);
+            if (keep)
+                memcpy(base, ptr, keep * sizeof(T));
+            fill(base + keep, base + count, T(0));
+        }
+        release();
+        win = fresh;
+        ptr = base;
+        n = count;
+        sync();
+    }
+    void resize(size_t count) { allocate(count, *nc); }
+
+    void release()
+    {
+        if (win == MPI_WIN_NULL)
+            return;
+        MPI_Win_unlock_all(win);
+        MPI_Win_free(&win);
+        ptr = nullptr;
+    }
+
+    // Makes every rank's writes visible to the node (collective on the node)
+    void sync()
+    {
+        MPI_Win_sync(win);
+        MPI_Barrier(nc->node);
+        MPI_Win_sync(win);
+    }
+
+    // Element-wise sum of the node copies, left on every node (collective)
+    void sum_across_nodes()
+    {
+        sync();
+        if (nc->leaders != MPI_COMM_NULL)
+        {
+            int nodes;
+            MPI_Comm_size(nc->leaders, &nodes);
+            if (nodes > 1)
+            {
+                MPI_Allreduce(MPI_IN_PLACE, ptr, n, mpi_type<T>(), MPI_SUM, nc->leaders);
+                profiler.collective("Allreduce", n * sizeof(T), n * sizeof(T), 0);
+            }
+        }
+        sync();
+    }
+
+    void add(size_t i, T v) { __atomic_fetch_add(ptr + i, v, __ATOMIC_RELAXED); }
+    T &operator[](size_t i) { return ptr[i]; }
+    const T &operator[](size_t i) const { return ptr[i]; }
+    size_t size() const { return n; }
+};
+
+// --- This rank's share of the graph ---
+// Full neighbor lists of the vertices it owns (the wedge centers it maps),
+// plus the degree of every vertex, which the ordered mode ranks by (shared
+// by the node, and as of the initial graph).
+struct Graph
+{
+    int total_vertices = 0;
+    vector<vertex_t> owned;        // owned[i] is the center whose neighbors are adj[i]
+    vector<vector<vertex_t>> adj;
+    NodeArray<int> degree;         // indexed by vertex id
+
+    // Index of v in owned (sorted), or -1 when another rank maps it
+    int local_index(vertex_t v) const
+    {
+        auto it = lower_bound(owned.begin(), owned.end(), v);
+        return it != owned.end() && *it == v ? it - owned.begin() : -1;
+    }
+};
+
 // --- Job 1: Map Edges to Wedges ---
-void map_job1(int rank, int world_size, int total_vertices, const vector<vector<vertex_t>> &adj, map<int, vector<wedge_t>> &wedges_to_send)
+// Calls emit(v1, v2, center) with v1 < v2 for every wedge centered on one of
+// this rank's vertices.
+template <class Emit>
+void map_job1(const Graph &g, Emit emit)
 {
-    hash<vertex_t> hasher;
-    for (vertex_t center_v = rank; center_v < total_vertices; center_v += world_size)
+    for (size_t c = 0; c < g.owned.size(); ++c)
     {
-        const auto &neighbors = adj.at(center_v);
+        vertex_t center_v = g.owned[c];
+        const auto &neighbors = g.adj[c];
         if (neighbors.size() < 2)
             continue;
         for (size_t i = 0; i < neighbors.size(); ++i)
         {
             for (size_t j = i + 1; j < neighbors.size(); ++j)
             {
-                vertex_t v1 = min(neighbors[i], neighbors[j]);
-                vertex_t v2 = max(neighbors[i], neighbors[j]);
-                int dest_rank = hasher(v1) % world_size;
-                wedges_to_send[dest_rank].push_back({{v1, v2}, center_v});
+                emit(min(neighbors[i], neighbors[j]), max(neighbors[i], neighbors[j]), center_v);
             }
         }
     }
 }
 
+// --- Job 1, degree-ordered: each cycle is emitted from its top vertex only ---
+// Vertices are ranked by (degree, id). A 4-cycle u - v - w - x whose
+// highest-ranked vertex is u is found exactly once, as the two wedges
+// u - v - w and u - x - w: wedges whose endpoint u outranks both the center and
+// the other endpoint. Hubs rank high, so they rarely act as centers and the
+// d^2 / 2 wedges around them are never built. Every cycle is counted once
+// instead of twice. Needs a simple graph: with self loops or repeated edges
+// the top-vertex argument breaks, so main falls back to map_job1 on such input.
+inline bool ranks_before(const Graph &g, vertex_t a, vertex_t b)
+{
+    return g.degree[a] != g.degree[b] ? g.degree[a] < g.degree[b] : a < b;
+}
+
+// Sorts every neighbor list by rank, once, for the ordered mappers
+void sort_adjacency_by_rank(Graph &g)
+{
+    for (auto &neighbors : g.adj)
+    {
+        sort(neighbors.begin(), neighbors.end(), [&](vertex_t a, vertex_t b)
+             { return ranks_before(g, a, b); });
+    }
+}
+
+// Whether any rank's lists hold a self loop or a repeated edge; lists must
+// be sorted by rank, so repeats sit next to each other. Collective.
+bool has_repeated_edges(const Graph &g)
+{
+    int found = 0;
+    for (size_t c = 0; c < g.owned.size() && !found; ++c)
+    {
+        const auto &neighbors = g.adj[c];
+        for (size_t i = 0; i < neighbors.size() && !found; ++i)
+            found = neighbors[i] == g.owned[c] || (i > 0 && neighbors[i] == neighbors[i - 1]);
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &found, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    profiler.collective("Allreduce", sizeof(int), sizeof(int), 0);
+    return found;
+}
+
+// Position of the first neighbor of owned[c] that outranks it (lists sorted by rank)
+inline size_t first_higher_neighbor(const Graph &g, size_t c)
+{
+    const auto &neighbors = g.adj[c];
+    return partition_point(neighbors.begin(), neighbors.end(), [&](vertex_t x)
+                           { return ranks_before(g, x, g.owned[c]); }) -
+           neighbors.begin();
+}
+
+template <class Emit>
+void map_job1_ordered(const Graph &g, Emit emit)
+{
+    for (size_t c = 0; c < g.owned.size(); ++c)
+    {
+        vertex_t center_v = g.owned[c];
+        const auto &neighbors = g.adj[c];
+        if (neighbors.size() < 2)
+            continue;
+        // Endpoints that outrank the center, each paired with every lower-ranked neighbor
+        for (size_t j = max<size_t>(first_higher_neighbor(g, c), 1); j < neighbors.size(); ++j)
+        {
+            for (size_t i = 0; i < j; ++i)
+            {
+                emit(min(neighbors[i], neighbors[j]), max(neighbors[i], neighbors[j]), center_v);
+            }
+        }
+    }
+}
+
+// Number of wedges this rank's mapper will emit, in closed form
+long long count_wedges(const Graph &g, bool ordered)
+{
+    long long total = 0;
+    for (size_t c = 0; c < g.owned.size(); ++c)
+    {
+        long long d = g.adj[c].size();
+        if (!ordered)
+        {
+            total += d * (d - 1) / 2;
+            continue;
+        }
+        // sum of j for j in [max(first, 1), d)
+        long long first = max<long long>(first_higher_neighbor(g, c), 1);
+        if (first < d)
+            total += (d * (d - 1) - first * (first - 1)) / 2;
+    }
+    return total;
+}
+
+// --- Heavy pairs ---
+// A pair shared by many centers (two hubs with many common neighbors) sends
+// all of its wedges to one reducer. With --split-heavy the pairs among the
+// top HEAVY_HUBS vertices by degree are counted exactly before the shuffle,
+// and a pair worth more than a quarter of a reducer's fair share is spread
+// over all reducers by center. Each reducer sums its share of k, one
+// Allreduce per round adds the shares, and centers are credited where they
+// landed.
+const int HEAVY_HUBS = 256;
+
+struct HeavyPairs
+{
+    vector<char> is_hub;   // by vertex; only pairs of hubs can be heavy
+    vector<uint64_t> keys; // sorted
+
+    // Position of `key` in keys, or -1
+    int index(uint64_t key) const
+    {
+        if (keys.empty() || !is_hub[key >> 32] || !is_hub[key & 0xffffffffu])
+            return -1;
+        auto it = lower_bound(keys.begin(), keys.end(), key);
+        return it != keys.end() && *it == key ? it - keys.begin() : -1;
+    }
+};
+
+HeavyPairs find_heavy_pairs(const Graph &g, bool ordered, int world_size)
+{
+    HeavyPairs heavy;
+    vector<vertex_t> hubs(g.total_vertices);
+    for (vertex_t v = 0; v < g.total_vertices; ++v)
+        hubs[v] = v;
+    int h = min<int>(HEAVY_HUBS, g.total_vertices);
+    partial_sort(hubs.begin(), hubs.begin() + h, hubs.end(), [&](vertex_t a, vertex_t b)
+                 { return ranks_before(g, b, a); });
+    hubs.resize(h);
+    sort(hubs.begin(), hubs.end());
+    vector<int> hub_index(g.total_vertices, -1);
+    heavy.is_hub.assign(g.total_vertices, 0);
+    for (int i = 0; i < h; ++i)
+    {
+        hub_index[hubs[i]] = i;
+        heavy.is_hub[hubs[i]] = 1;
+    }
+
+    // k for every hub pair, over the wedges the mappers will actually emit:
+    // in ordered mode only those whose higher endpoint outranks the center
+    vector<long long> k(h * h, 0);
+    vector<vertex_t> hub_neighbors;
+    for (size_t c = 0; c < g.owned.size(); ++c)
+    {
+        hub_neighbors.clear();
+        for (vertex_t x : g.adj[c])
+        {
+            if (hub_index[x] >= 0)
+                hub_neighbors.push_back(x);
+        }
+        for (size_t i = 0; i < hub_neighbors.size(); ++i)
+        {
+            for (size_t j = i + 1; j < hub_neighbors.size(); ++j)
+            {
+                vertex_t a = hub_neighbors[i], b = hub_neighbors[j];
+                if (ordered && !ranks_before(g, g.owned[c], ranks_before(g, a, b) ? b : a))
+                    continue;
+                k[hub_index[min(a, b)] * h + hub_index[max(a, b)]]++;
+            }
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, k.data(), k.size(), MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    profiler.collective("Allreduce", k.size() * sizeof(long long), k.size() * sizeof(long long), 0);
+
+    long long local_wedges = count_wedges(g, ordered), total_wedges = 0;
+    MPI_Allreduce(&local_wedges, &total_wedges, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    profiler.collective("Allreduce", sizeof(long long), sizeof(long long), 0);
+    long long threshold = max(2LL, total_wedges / (4LL * world_size));
+    for (int i = 0; i < h; ++i)
+    {
+        for (int j = i + 1; j < h; ++j)
+        {
+            if (k[i * h + j] > threshold)
+                heavy.keys.push_back(pair_key(hubs[i], hubs[j]));
+        }
+    }
+    return heavy;
+}
+
+// LSD radix sort of wedges by key, 8 bits per pass. One histogram pass counts
+// all eight digits up front, and digits where every key agrees (the high bytes
+// of each vertex id on all but huge graphs) are skipped.
+void radix_sort_wedges(vector<wedge_t> &wedges)
+{
+    size_t n = wedges.size();
+    vector<array<size_t, 256>> hist(8);
+    for (auto &h : hist)
+        h.fill(0);
+    for (const auto &w : wedges)
+    {
+        for (int d = 0; d < 8; ++d)
+            hist[d][(w.key >> (8 * d)) & 0xff]++;
+    }
+
+    vector<wedge_t> scratch(n);
+    for (int d = 0; d < 8; ++d)
+    {
+        auto &h = hist[d];
+        if (n == 0 || h[(wedges[0].key >> (8 * d)) & 0xff] == n)
+            continue;
+        size_t offset = 0;
+        for (size_t &c : h)
+        {
+            size_t count = c;
+            c = offset;
+            offset += count;
+        }
+        for (const auto &w : wedges)
+            scratch[h[(w.key >> (8 * d)) & 0xff]++] = w;
+        wedges.swap(scratch);
+    }
+}
+
 // --- Job 2 & 3: Reduce Wedges to Counts ---
-void reduce_jobs_2_and_3(const vector<wedge_t> &received_wedges, count_t &local_global_count, map<vertex_t, count_t> &local_per_vertex_counts)
+// Sorting brings every wedge on the same (v1, v2) pair into one run of length
+// k; the pair closes k choose 2 cycles, and each center in the run lies on
+// k - 1 of them. Counts land in a flat array indexed by vertex. Runs of a
+// split heavy pair only add their length to heavy_k and park their centers.
+void reduce_jobs_2_and_3(vector<wedge_t> &received_wedges, count_t &local_global_count, NodeArray<count_t> &node_per_vertex_counts,
+                         const HeavyPairs &heavy, vector<count_t> &heavy_k, vector<pvc_pair_t> &heavy_centers)
 {
-    map<edge_t, vector<vertex_t>> grouped_wedges;
-    for (const auto &wedge : received_wedges)
+    radix_sort_wedges(received_wedges);
+    size_t n = received_wedges.size();
+    for (size_t begin = 0, end; begin < n; begin = end)
     {
-        grouped_wedges[wedge.first].push_back(wedge.second);
+        uint64_t key = received_wedges[begin].key;
+        for (end = begin + 1; end < n && received_wedges[end].key == key; ++end)
+            ;
+        count_t k = end - begin;
+        int h = heavy.index(key);
+        if (h >= 0)
+        {
+            heavy_k[h] += k;
+            for (size_t i = begin; i < end; ++i)
+                heavy_centers.push_back({received_wedges[i].center, h});
+            continue;
+        }
+        if (k < 2)
+            continue;
+        count_t cycles_found = k * (k - 1) / 2;
+        local_global_count += cycles_found;
+        node_per_vertex_counts.add(key >> 32, cycles_found);
+        node_per_vertex_counts.add(key & 0xffffffffu, cycles_found);
+        for (size_t i = begin; i < end; ++i)
+        {
+            node_per_vertex_counts.add(received_wedges[i].center, (k - 1));
+        }
     }
-    for (const auto &pair : grouped_wedges)
+}
+
+// --- Combiner: reduce side of a combined round ---
+// Each record carries a sender's wedge count for one pair in its `center`
+// field. Counts for the same pair are summed to the global k, the endpoints
+// are credited here, and k is written back per record (reply[i] for recv[i])
+// so each sender can credit its own centers with k - 1.
+void reduce_combined(const vector<wedge_t> &received, vector<count_t> &reply, count_t &local_global_count, NodeArray<count_t> &node_per_vertex_counts)
+{
+    // Sort (key, record index) so the replies can go back in arrival order
+    vector<wedge_t> order(received.size());
+    for (size_t i = 0; i < received.size(); ++i)
+        order[i] = {received[i].key, (vertex_t)i};
+    radix_sort_wedges(order);
+
+    reply.assign(received.size(), 0);
+    size_t n = order.size();
+    for (size_t begin = 0, end; begin < n; begin = end)
     {
-        count_t k = pair.second.size();
+        uint64_t key = order[begin].key;
+        count_t k = 0;
+        for (end = begin; end < n && order[end].key == key; ++end)
+            k += received[order[end].center].center;
+        for (size_t i = begin; i < end; ++i)
+            reply[order[i].center] = k;
         if (k < 2)
             continue;
         count_t cycles_found = k * (k - 1) / 2;
         local_global_count += cycles_found;
-        const vertex_t v1 = pair.first.first;
-        const vertex_t v2 = pair.first.second;
-        local_per_vertex_counts[v1] += cycles_found;
-        local_per_vertex_counts[v2] += cycles_found;
-        for (const auto &center_v : pair.second)
+        node_per_vertex_counts.add(key >> 32, cycles_found);
+        node_per_vertex_counts.add(key & 0xffffffffu, cycles_found);
+    }
+}
+
+// --- Compressed shuffle payloads (--compress) ---
+// A destination's wedges, sorted by key, go out as varints: the first
+// endpoint as a delta from the previous wedge's, the second as a delta while
+// the first repeats and whole otherwise, then the center (or, with the
+// combiner, the count). Neighbouring pairs share endpoints, so a wedge takes
+// 4 to 6 bytes instead of 12 on the generated graphs.
+void encode_wedges(vector<char> &out, const wedge_t *wedges, size_t n)
+{
+    WireWriter w(out);
+    uint64_t prev_v1 = 0, prev_v2 = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint64_t v1 = wedges[i].key >> 32, v2 = wedges[i].key & 0xffffffffu;
+        w.put(v1 - prev_v1);
+        w.put(v1 == prev_v1 ? v2 - prev_v2 : v2);
+        w.put((uint32_t)wedges[i].center);
+        prev_v1 = v1;
+        prev_v2 = v2;
+    }
+}
+
+void decode_wedges(const char *data, size_t bytes, wedge_t *out, size_t n)
+{
+    WireReader r(data, bytes);
+    uint64_t v1 = 0, v2 = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint64_t d1 = r.get(), d2 = r.get();
+        v2 = d1 == 0 ? v2 + d2 : d2;
+        v1 += d1;
+        out[i] = {v1 << 32 | v2, (vertex_t)r.get()};
+    }
+}
+
+// One destination's per-vertex counts (ascending vertices): the pair count,
+// then vertex deltas and zigzag counts, which updates can make negative
+void encode_vertex_counts(vector<char> &out, const vector<pvc_pair_t> &pairs)
+{
+    WireWriter w(out);
+    w.put(pairs.size());
+    vertex_t prev = 0;
+    for (const auto &pair : pairs)
+    {
+        w.put((uint32_t)(pair.first - prev));
+        w.put_signed(pair.second);
+        prev = pair.first;
+    }
+}
+
+void decode_vertex_counts(const char *data, size_t bytes, vector<pvc_pair_t> &out)
+{
+    WireReader r(data, bytes);
+    size_t n = r.get();
+    vertex_t v = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        v += (vertex_t)r.get();
+        out.push_back({v, r.get_signed()});
+    }
+}
+
+// --- Bounded-memory wedge shuffle ---
+// Wedges travel in rounds: round r carries only the pairs whose mixed key
+// falls in residue r, so every pair's wedges meet on their reducer in the same
+// round and each round is reduced and freed before the next one lands. While
+// round r is in flight (MPI_Ialltoallv) the mappers build round r + 1.
+// MPI 4 builds pass 64-bit counts (the _c calls); older ones use int counts of
+// whole wedges, which the round budget keeps in range.
+//
+// With the combiner, each mapper sorts a round's wedges per destination and
+// sends one (pair, local count) record per distinct pair instead of every
+// wedge; the centers never leave the rank. The reducer answers each record
+// with the pair's global k, and the mapper credits its centers with k - 1.
+#if MPI_VERSION >= 4
+using mpi_count_t = MPI_Count;
+using mpi_displ_t = MPI_Aint;
+#else
+using mpi_count_t = int;
+using mpi_displ_t = int;
+#endif
+
+// Wedge buffers (send, in-flight send, receive, sort scratch, map buckets)
+// live at once; the round budget splits the ceiling across them
+const int SHUFFLE_BUFFERS = 5;
+
+inline uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Reducer of a pair: the high half of its mixed key scaled to [0, n), so the
+// choice is independent of the round (the low bits, mod rounds) and of the
+// id layout; std::hash<int> is the identity and left runs of ids together
+inline int reducer_of(uint64_t key, int n)
+{
+    return (int)((mix64(key) >> 32) * (uint64_t)n >> 32);
+}
+
+struct ShuffleRound
+{
+    vector<wedge_t> send, recv;
+    vector<wedge_t> local; // combiner: this rank's wedges, sorted per destination
+    vector<mpi_count_t> send_counts, recv_counts;
+    vector<mpi_displ_t> send_displs, recv_displs;
+    // --compress: the encoded send/recv buffers and their byte counts
+    vector<char> wire_send, wire_recv;
+    vector<mpi_count_t> wire_send_counts, wire_recv_counts;
+    vector<mpi_displ_t> wire_send_displs, wire_recv_displs;
+    MPI_Request request = MPI_REQUEST_NULL;
+};
+
+struct WedgeShuffle
+{
+    int rank, world_size, rounds;
+    bool ordered, combine;
+    const Graph &graph;
+    const HeavyPairs &heavy;
+    MPI_Datatype wedge_type;
+    vector<vector<wedge_t>> buckets;
+    long long wedges_sent = 0, wedges_received = 0;
+    long long records_sent = 0, reply_bytes = 0;
+    double map_seconds = 0, reduce_seconds = 0;
+    double sort_for_wire_seconds = 0; // --compress sorts plain rounds; charged to encoding
+    vector<count_t> heavy_k;
+    vector<pvc_pair_t> heavy_centers;
+
+    WedgeShuffle(int rank, int world_size, const Graph &graph, const HeavyPairs &heavy, bool ordered, bool combine, int rounds)
+        : rank(rank), world_size(world_size), rounds(rounds), ordered(ordered), combine(combine), graph(graph), heavy(heavy),
+          buckets(world_size), heavy_k(heavy.keys.size(), 0)
+    {
+        MPI_Type_contiguous(sizeof(wedge_t), MPI_BYTE, &wedge_type);
+        MPI_Type_commit(&wedge_type);
+    }
+    ~WedgeShuffle()
+    {
+        // main's shuffle outlives MPI_Finalize; the type goes with it then
+        int finalized;
+        MPI_Finalized(&finalized);
+        if (!finalized)
+            MPI_Type_free(&wedge_type);
+    }
+
+    // Maps round r into out.send, grouped by destination. `in_flight` is
+    // polled now and then so the previous round's exchange keeps moving.
+    void generate(int r, ShuffleRound &out, MPI_Request *in_flight)
+    {
+        ScopedPhase phase("map");
+        double t0 = MPI_Wtime();
+        long long emitted = 0;
+        auto emit = [&](vertex_t v1, vertex_t v2, vertex_t center_v)
+        {
+            uint64_t key = pair_key(v1, v2);
+            if (rounds > 1 && (int)(mix64(key) % rounds) != r)
+                return;
+            int dest = heavy.index(key) >= 0 ? reducer_of(center_v, world_size) : reducer_of(key, world_size);
+            buckets[dest].push_back({key, center_v});
+            if ((++emitted & 0xffff) == 0 && *in_flight != MPI_REQUEST_NULL)
+            {
+                int done;
+                MPI_Test(in_flight, &done, MPI_STATUS_IGNORE);
+            }
+        };
+        if (ordered)
+            map_job1_ordered(graph, emit);
+        else
+            map_job1(graph, emit);
+
+        out.send.clear();
+        out.local.clear();
+        out.send_counts.assign(world_size, 0);
+        out.send_displs.assign(world_size, 0);
+        if (combine)
+            out.local.reserve(emitted);
+        else
+            out.send.reserve(emitted);
+        for (int p = 0; p < world_size; ++p)
         {
-            local_per_vertex_counts[center_v] += (k - 1);
+            out.send_displs[p] = out.send.size();
+            if (combine)
+            {
+                // One (pair, count) record per run of equal keys
+                radix_sort_wedges(buckets[p]);
+                const auto &sorted = buckets[p];
+                for (size_t begin = 0, end; begin < sorted.size(); begin = end)
+                {
+                    for (end = begin + 1; end < sorted.size() && sorted[end].key == sorted[begin].key; ++end)
+                        ;
+                    out.send.push_back({sorted[begin].key, (vertex_t)(end - begin)});
+                }
+                out.local.insert(out.local.end(), sorted.begin(), sorted.end());
+            }
+            else
+            {
+                // The codec wants each destination's wedges in key order;
+                // the reducer sorts them anyway, so order is free to change
+                if (wire_codec.on())
+                {
+                    double t_sort = MPI_Wtime();
+                    radix_sort_wedges(buckets[p]);
+                    sort_for_wire_seconds += MPI_Wtime() - t_sort;
+                }
+                out.send.insert(out.send.end(), buckets[p].begin(), buckets[p].end());
+            }
+            out.send_counts[p] = out.send.size() - out.send_displs[p];
+            buckets[p].clear();
         }
+        wedges_sent += emitted;
+        records_sent += out.send.size();
+        map_seconds += MPI_Wtime() - t0;
     }
+
+    // Adds up every reducer's share of the round's heavy pairs; the pair's
+    // cycles are credited once, by rank h % world_size, and each parked
+    // center on whichever rank holds it
+    void settle_heavy(count_t &local_global_count, NodeArray<count_t> &node_per_vertex_counts)
+    {
+        if (heavy_k.empty())
+            return;
+        MPI_Allreduce(MPI_IN_PLACE, heavy_k.data(), heavy_k.size(), MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+        profiler.collective("Allreduce", heavy_k.size() * sizeof(count_t), heavy_k.size() * sizeof(count_t), 0);
+        for (size_t h = 0; h < heavy_k.size(); ++h)
+        {
+            count_t k = heavy_k[h];
+            if (k >= 2 && (int)(h % world_size) == rank)
+            {
+                count_t cycles_found = k * (k - 1) / 2;
+                local_global_count += cycles_found;
+                node_per_vertex_counts.add(heavy.keys[h] >> 32, cycles_found);
+                node_per_vertex_counts.add(heavy.keys[h] & 0xffffffffu, cycles_found);
+            }
+        }
+        for (const auto &parked : heavy_centers)
+        {
+            count_t k = heavy_k[parked.second];
+            if (k >= 2)
+                node_per_vertex_counts.add(parked.first, k - 1);
+        }
+        heavy_k.assign(heavy_k.size(), 0);
+        heavy_centers.clear();
+    }
+
+    // Combiner return pass: k for every record goes back to its sender, which
+    // credits each of its centers on the pair with k - 1
+    void finish_combined(ShuffleRound &round, count_t &local_global_count, NodeArray<count_t> &node_per_vertex_counts)
+    {
+        vector<count_t> reply, k_back(round.send.size());
+        {
+            ScopedPhase phase("reduce");
+            reduce_combined(round.recv, reply, local_global_count, node_per_vertex_counts);
+        }
+        {
+            ScopedPhase phase("combine_return");
+#if MPI_VERSION >= 4
+            MPI_Alltoallv_c(reply.data(), round.recv_counts.data(), round.recv_displs.data(), MPI_LONG_LONG,
+                            k_back.data(), round.send_counts.data(), round.send_displs.data(), MPI_LONG_LONG, MPI_COMM_WORLD);
+#else
+            MPI_Alltoallv(reply.data(), round.recv_counts.data(), round.recv_displs.data(), MPI_LONG_LONG,
+                          k_back.data(), round.send_counts.data(), round.send_displs.data(), MPI_LONG_LONG, MPI_COMM_WORLD);
+#endif
+            profiler.collective("Alltoallv", reply.size() * sizeof(count_t), k_back.size() * sizeof(count_t), world_size);
+            reply_bytes += reply.size() * sizeof(count_t);
+        }
+        ScopedPhase phase("reduce");
+        size_t pos = 0;
+        for (size_t j = 0; j < round.send.size(); ++j)
+        {
+            count_t k = k_back[j];
+            size_t run = round.send[j].center;
+            if (k >= 2)
+            {
+                for (size_t t = pos; t < pos + run; ++t)
+                    node_per_vertex_counts.add(round.local[t].center, k - 1);
+            }
+            pos += run;
+        }
+    }
+
+    // Encodes every destination's wedges into round.wire_send (--compress)
+    void encode(ShuffleRound &round)
+    {
+        double t0 = MPI_Wtime();
+        round.wire_send.clear();
+        round.wire_send_counts.assign(world_size, 0);
+        round.wire_send_displs.assign(world_size, 0);
+        for (int p = 0; p < world_size; ++p)
+        {
+            round.wire_send_displs[p] = round.wire_send.size();
+            encode_wedges(round.wire_send, round.send.data() + round.send_displs[p], round.send_counts[p]);
+            round.wire_send_counts[p] = round.wire_send.size() - round.wire_send_displs[p];
+        }
+        wire_codec.encoded("wedges", round.send.size() * sizeof(wedge_t), round.wire_send.size(),
+                           MPI_Wtime() - t0 + sort_for_wire_seconds);
+        sort_for_wire_seconds = 0;
+    }
+
+    // Decodes an arrived compressed round into round.recv
+    void decode(ShuffleRound &round)
+    {
+        double t0 = MPI_Wtime();
+        for (int p = 0; p < world_size; ++p)
+            decode_wedges(round.wire_recv.data() + round.wire_recv_displs[p], round.wire_recv_counts[p],
+                          round.recv.data() + round.recv_displs[p], round.recv_counts[p]);
+        vector<char>().swap(round.wire_recv);
+        wire_codec.decoded("wedges", MPI_Wtime() - t0);
+    }
+
+    // Swaps counts (always 64-bit; with --compress, wedges then bytes per
+    // peer) and starts the round's exchange
+    void post(ShuffleRound &round)
+    {
+        bool compress = wire_codec.on();
+        if (compress)
+            encode(round);
+        int per_peer = compress ? 2 : 1;
+        vector<long long> send_counts(per_peer * world_size), recv_counts(per_peer * world_size);
+        for (int p = 0; p < world_size; ++p)
+        {
+            send_counts[per_peer * p] = round.send_counts[p];
+            if (compress)
+                send_counts[per_peer * p + 1] = round.wire_send_counts[p];
+        }
+        MPI_Alltoall(send_counts.data(), per_peer, MPI_LONG_LONG, recv_counts.data(), per_peer, MPI_LONG_LONG, MPI_COMM_WORLD);
+        profiler.collective("Alltoall", send_counts.size() * sizeof(long long), recv_counts.size() * sizeof(long long), world_size);
+
+        round.recv_counts.assign(world_size, 0);
+        round.recv_displs.assign(world_size, 0);
+        round.wire_recv_counts.assign(world_size, 0);
+        round.wire_recv_displs.assign(world_size, 0);
+        long long total = 0, wire_total = 0, messages = 0;
+        for (int p = 0; p < world_size; ++p)
+        {
+            long long count = recv_counts[per_peer * p], bytes = compress ? recv_counts[per_peer * p + 1] : 0;
+            if (total > (long long)numeric_limits<mpi_displ_t>::max() - count ||
+                wire_total > (long long)numeric_limits<mpi_displ_t>::max() - bytes)
+            {
+                cerr << "Error: a shuffle round overflows this MPI's counts; lower --shuffle-mem." << endl;
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            round.recv_displs[p] = total;
+            round.recv_counts[p] = count;
+            total += count;
+            round.wire_recv_displs[p] = wire_total;
+            round.wire_recv_counts[p] = bytes;
+            wire_total += bytes;
+            messages += send_counts[per_peer * p] > 0;
+        }
+        round.recv.resize(total);
+        wedges_received += total;
+
+        // Plain rounds move wedges, compressed ones bytes
+        const void *send_buf = round.send.data();
+        void *recv_buf = round.recv.data();
+        const mpi_count_t *send_counts_t = round.send_counts.data(), *recv_counts_t = round.recv_counts.data();
+        const mpi_displ_t *send_displs_t = round.send_displs.data(), *recv_displs_t = round.recv_displs.data();
+        MPI_Datatype type = wedge_type;
+        if (compress)
+        {
+            round.wire_recv.resize(wire_total);
+            send_buf = round.wire_send.data();
+            recv_buf = round.wire_recv.data();
+            send_counts_t = round.wire_send_counts.data();
+            recv_counts_t = round.wire_recv_counts.data();
+            send_displs_t = round.wire_send_displs.data();
+            recv_displs_t = round.wire_recv_displs.data();
+            type = MPI_BYTE;
+            profiler.collective("Ialltoallv", round.wire_send.size(), wire_total, messages);
+        }
+        else
+        {
+            profiler.collective("Ialltoallv", round.send.size() * sizeof(wedge_t), total * sizeof(wedge_t), messages);
+        }
+#if MPI_VERSION >= 4
+        MPI_Ialltoallv_c(send_buf, send_counts_t, send_displs_t, type, recv_buf, recv_counts_t, recv_displs_t, type,
+                         MPI_COMM_WORLD, &round.request);
+#else
+        MPI_Ialltoallv(send_buf, send_counts_t, send_displs_t, type, recv_buf, recv_counts_t, recv_displs_t, type,
+                       MPI_COMM_WORLD, &round.request);
+#endif
+    }
+
+    // Runs all rounds, reducing each one as soon as it has arrived
+    void run(count_t &local_global_count, NodeArray<count_t> &node_per_vertex_counts)
+    {
+        ShuffleRound current, next;
+        generate(0, current, &next.request);
+        post(current);
+        for (int r = 0; r < rounds; ++r)
+        {
+            if (r + 1 < rounds)
+                generate(r + 1, next, &current.request);
+            {
+                ScopedPhase phase("shuffle");
+                MPI_Wait(&current.request, MPI_STATUS_IGNORE);
+                if (wire_codec.on())
+                    decode(current);
+            }
+            if (combine)
+            {
+                double t0 = MPI_Wtime();
+                finish_combined(current, local_global_count, node_per_vertex_counts);
+                reduce_seconds += MPI_Wtime() - t0;
+            }
+            else
+            {
+                ScopedPhase phase("reduce");
+                double t0 = MPI_Wtime();
+                reduce_jobs_2_and_3(current.recv, local_global_count, node_per_vertex_counts, heavy, heavy_k, heavy_centers);
+                reduce_seconds += MPI_Wtime() - t0;
+                settle_heavy(local_global_count, node_per_vertex_counts);
+            }
+            if (r + 1 < rounds)
+            {
+                ScopedPhase phase("shuffle");
+                post(next);
+                swap(current, next);
+            }
+        }
+    }
+};
+
+// Rounds needed to keep the busiest rank's wedge buffers under `mem_bytes`
+int shuffle_rounds(long long local_wedges, long long mem_bytes)
+{
+    long long busiest;
+    MPI_Allreduce(&local_wedges, &busiest, 1, MPI_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+    long long budget = max(1LL, mem_bytes / (SHUFFLE_BUFFERS * (long long)sizeof(wedge_t)));
+#if MPI_VERSION < 4
+    budget = min<long long>(budget, numeric_limits<int>::max());
+#endif
+    return max(1LL, (busiest + budget - 1) / budget);
 }
 
-int main(int argc, char *argv[])
+// --- Parallel ingest ---
+// Every rank reads one byte range of the edge list with MPI-IO and parses the
+// lines that start inside it, reading past the range end to finish its last
+// line. Names are interned by a distributed hash: each name's owner
+// (hash % ranks) numbers the names sent to it, and the owners take consecutive
+// id blocks, so ids are dense and no rank ever holds the whole graph.
+using name_pair_t = pair<string_view, string_view>;
+
+// This rank's lines of `path`, whole lines only. `first_line` is set on the
+// rank whose lines start at byte 0: rank 0, unless the file has fewer bytes
+// than there are ranks and leading ranks get empty ranges.
+string read_my_lines(const char *path, int rank, int world_size, bool &first_line)
 {
-    // freopen("output.txt", "w", stdout); // file output.txt is opened in writing mode i.e "w"
-    // freopen("bench.txt", "w", stderr);  // file output.txt is opened in writing mode i.e "w"
-    MPI_Init(&argc, &argv);
-    int rank, world_size;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+    {
+        if (rank == 0)
+            cerr << "Error: could not open " << path << "." << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Offset size;
+    MPI_File_get_size(fh, &size);
+    MPI_Offset lo = size * rank / world_size, hi = size * (rank + 1) / world_size;
 
-    if (world_size < 2)
-    { /* Error handling */
+    string text;
+    auto read_at = [&](MPI_Offset at, MPI_Offset len)
+    {
+        size_t old = text.size();
+        text.resize(old + len);
+        MPI_Offset done = 0;
+        while (done < len)
+        {
+            MPI_Status status;
+            int got;
+            if (MPI_File_read_at(fh, at + done, &text[old + done], (int)min<MPI_Offset>(len - done, 1 << 30), MPI_CHAR, &status) != MPI_SUCCESS)
+            {
+                cerr << "Error: rank " << rank << " could not read " << path << " at offset " << at + done << "." << endl;
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            MPI_Get_count(&status, MPI_CHAR, &got);
+            if (got <= 0)
+                break;
+            done += got;
+        }
+        text.resize(old + done);
+        profiler.collective("File_read_at", 0, done, 0);
+    };
+
+    // One byte of look-behind: a line starts at lo only if lo is 0 or lo - 1
+    // is a newline
+    first_line = lo == 0 && hi > 0;
+    MPI_Offset from = lo == 0 ? 0 : lo - 1;
+    read_at(from, hi - from);
+    size_t begin = 0;
+    if (lo != 0)
+    {
+        size_t nl = text.find('\n');
+        begin = (nl == string::npos || (MPI_Offset)nl + 1 >= hi - from) ? text.size() : nl + 1;
+    }
+    // Finish the last line that starts in range
+    for (MPI_Offset end = hi; begin < text.size() && text.back() != '\n' && end < size;)
+    {
+        size_t old = text.size();
+        MPI_Offset len = min<MPI_Offset>(1 << 16, size - end);
+        read_at(end, len);
+        end += len;
+        size_t nl = text.find('\n', old);
+        if (nl != string::npos)
+            text.resize(nl + 1);
     }
+    MPI_File_close(&fh);
+    return text.substr(begin);
+}
 
-    MPI_Barrier(MPI_COMM_WORLD);
-    double start_time = MPI_Wtime();
+// First two whitespace-separated tokens of every line with at least two
+string_view next_token(string_view line, size_t &pos)
+{
+    while (pos < line.size() && isspace((unsigned char)line[pos]))
+        ++pos;
+    size_t start = pos;
+    while (pos < line.size() && !isspace((unsigned char)line[pos]))
+        ++pos;
+    return line.substr(start, pos - start);
+}
 
-    // --- Step 1: Coordinator reads and broadcasts initial data ---
-    vector<edge_t> all_edges;
-    map<vertex_t, string> id_to_name;
-    int total_vertices = 0;
+vector<name_pair_t> parse_edge_lines(string_view text)
+{
+    vector<name_pair_t> pairs;
+    for (size_t begin = 0, end; begin < text.size(); begin = end + 1)
+    {
+        end = text.find('\n', begin);
+        if (end == string_view::npos)
+            end = text.size();
+        string_view line = text.substr(begin, end - begin);
+        size_t pos = 0;
+        string_view u = next_token(line, pos), v = next_token(line, pos);
+        if (!v.empty())
+            pairs.push_back({u, v});
+    }
+    return pairs;
+}
 
-    if (rank == 0)
+// With --header the file starts with an "n m" line, as generate.cpp writes;
+// the rank holding the first line drops it
+void drop_header_line(vector<name_pair_t> &pairs, bool first_line)
+{
+    if (first_line && !pairs.empty())
+        pairs.erase(pairs.begin());
+}
+
+inline uint64_t fnv1a(string_view s)
+{
+    uint64_t h = 1469598103934665603ULL;
+    for (char c : s)
+        h = (h ^ (unsigned char)c) * 1099511628211ULL;
+    return h;
+}
+
+// Ids are split into one consecutive block per rank; the block's names live
+// there. Vertices added by later updates follow the blocks, known everywhere.
+struct NameTable
+{
+    int rank = 0;
+    vector<vertex_t> id_begin; // rank p owns ids [id_begin[p], id_begin[p + 1])
+    vector<string> names;      // names of this rank's block, in id order (sorted)
+    vector<string> added;      // id id_begin.back() + i, on every rank
+    unordered_map<string, vertex_t> added_index;
+
+    int total() const { return id_begin.back() + added.size(); }
+    int owner(vertex_t v) const
     {
-        // ... (File reading and string-to-int mapping logic is unchanged) ...
-        map<string, vertex_t> name_to_id;
-        vertex_t next_id = 0;
-        ifstream input_file("input.txt");
-        if (!input_file.is_open())
+        if (v >= id_begin.back())
+            return (v - id_begin.back()) % (id_begin.size() - 1);
+        return upper_bound(id_begin.begin(), id_begin.end(), v) - id_begin.begin() - 1;
+    }
+    // Name of a vertex this rank owns
+    const string &name_of(vertex_t v) const
+    {
+        return v >= id_begin.back() ? added[v - id_begin.back()] : names[v - id_begin[rank]];
+    }
+};
+
+// Sends each distinct local name to its owner, which numbers the names it
+// receives in sorted order, and returns the edges translated to global ids
+vector<edge_t> intern_names(const vector<name_pair_t> &pairs, int rank, int world_size, NameTable &table)
+{
+    unordered_map<string_view, int> local_index;
+    vector<string_view> local_names;
+    vector<edge_t> edges;
+    edges.reserve(pairs.size());
+    auto index_of = [&](string_view name)
+    {
+        auto it = local_index.emplace(name, (int)local_names.size());
+        if (it.second)
+            local_names.push_back(name);
+        return it.first->second;
+    };
+    for (const auto &p : pairs)
+    {
+        int u = index_of(p.first);
+        edges.push_back({u, index_of(p.second)});
+    }
+
+    // Requests: names grouped by owner, newline-terminated
+    vector<int> owner(local_names.size()), names_to(world_size, 0), send_counts(world_size, 0);
+    for (size_t i = 0; i < local_names.size(); ++i)
+    {
+        owner[i] = fnv1a(local_names[i]) % world_size;
+        names_to[owner[i]]++;
+        send_counts[owner[i]] += local_names[i].size() + 1;
+    }
+    vector<int> send_displs(world_size + 1, 0), slot(world_size + 1, 0);
+    for (int p = 0; p < world_size; ++p)
+    {
+        send_displs[p + 1] = send_displs[p] + send_counts[p];
+        slot[p + 1] = slot[p] + names_to[p];
+    }
+    vector<char> send_buffer(send_displs[world_size]);
+    vector<int> request_order(local_names.size()); // local index of the k-th name sent
+    {
+        vector<int> pos(send_displs.begin(), send_displs.end() - 1), next(slot.begin(), slot.end() - 1);
+        for (size_t i = 0; i < local_names.size(); ++i)
+        {
+            int p = owner[i];
+            memcpy(&send_buffer[pos[p]], local_names[i].data(), local_names[i].size());
+            pos[p] += local_names[i].size();
+            send_buffer[pos[p]++] = '\n';
+            request_order[next[p]++] = i;
+        }
+    }
+
+    vector<int> recv_counts(world_size);
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    profiler.collective("Alltoall", world_size * sizeof(int), world_size * sizeof(int), world_size);
+    vector<int> recv_displs(world_size + 1, 0);
+    for (int p = 0; p < world_size; ++p)
+        recv_displs[p + 1] = recv_displs[p] + recv_counts[p];
+    vector<char> recv_buffer(recv_displs[world_size]);
+    MPI_Alltoallv(send_buffer.data(), send_counts.data(), send_displs.data(), MPI_CHAR,
+                  recv_buffer.data(), recv_counts.data(), recv_displs.data(), MPI_CHAR, MPI_COMM_WORLD);
+    profiler.exchange("Alltoallv", send_counts.data(), recv_counts.data(), world_size, 1);
+
+    // Number the owned names, then answer every request in arrival order
+    vector<string_view> requested;
+    vector<int> reply_counts(world_size, 0);
+    for (int p = 0; p < world_size; ++p)
+    {
+        for (int b = recv_displs[p], e; b < recv_displs[p + 1]; b = e + 1)
         {
-            cerr << "Error: Rank 0 could not open input.txt." << endl;
-            MPI_Abort(MPI_COMM_WORLD, 1);
+            e = find(recv_buffer.begin() + b, recv_buffer.end(), '\n') - recv_buffer.begin();
+            requested.push_back(string_view(recv_buffer.data() + b, e - b));
+            reply_counts[p]++;
         }
+    }
+    vector<string_view> sorted_names(requested);
+    sort(sorted_names.begin(), sorted_names.end());
+    sorted_names.erase(unique(sorted_names.begin(), sorted_names.end()), sorted_names.end());
+
+    int owned = sorted_names.size(), base = 0;
+    table.id_begin.assign(world_size + 1, 0);
+    MPI_Allgather(&owned, 1, MPI_INT, table.id_begin.data() + 1, 1, MPI_INT, MPI_COMM_WORLD);
+    profiler.collective("Allgather", sizeof(int), world_size * sizeof(int), world_size - 1);
+    for (int p = 0; p < world_size; ++p)
+        table.id_begin[p + 1] += table.id_begin[p];
+    base = table.id_begin[rank];
+    table.rank = rank;
+    table.names.assign(sorted_names.begin(), sorted_names.end());
+
+    vector<vertex_t> reply(requested.size());
+    for (size_t k = 0; k < requested.size(); ++k)
+        reply[k] = base + (lower_bound(sorted_names.begin(), sorted_names.end(), requested[k]) - sorted_names.begin());
+    vector<int> reply_displs(world_size + 1, 0);
+    for (int p = 0; p < world_size; ++p)
+        reply_displs[p + 1] = reply_displs[p] + reply_counts[p];
+    vector<vertex_t> ids_back(local_names.size());
+    MPI_Alltoallv(reply.data(), reply_counts.data(), reply_displs.data(), MPI_INT,
+                  ids_back.data(), names_to.data(), slot.data(), MPI_INT, MPI_COMM_WORLD);
+    profiler.exchange("Alltoallv", reply_counts.data(), names_to.data(), world_size, sizeof(vertex_t));
+
+    vector<vertex_t> global_id(local_names.size());
+    for (size_t k = 0; k < local_names.size(); ++k)
+        global_id[request_order[k]] = ids_back[k];
+    for (auto &e : edges)
+        e = {global_id[e.first], global_id[e.second]};
+    return edges;
+}
+
+// Map work of every center, in wedges emitted plus the neighbor scan: the
+// closed form of count_wedges, from global degrees and, in ordered mode, the
+// number of lower-ranked neighbors (`lower`, null otherwise)
+vector<long long> center_work(const Graph &g, const NodeArray<int> *lower)
+{
+    vector<long long> work(g.total_vertices);
+    for (vertex_t v = 0; v < g.total_vertices; ++v)
+    {
+        long long d = g.degree[v], wedges = d * (d - 1) / 2;
+        if (lower)
+        {
+            long long first = max((*lower)[v], 1);
+            wedges = first < d ? (d * (d - 1) - first * (first - 1)) / 2 : 0;
+        }
+        work[v] = wedges + d;
+    }
+    return work;
+}
+
+// Greedy LPT bin packing: largest center first, each to the least-loaded
+// rank, so a hub gets a rank to itself instead of the one its id falls on.
+// Deterministic, so every rank computes the same owners.
+vector<int> assign_centers(const vector<long long> &work, int world_size)
+{
+    vector<vertex_t> order(work.size());
+    for (size_t v = 0; v < work.size(); ++v)
+        order[v] = v;
+    sort(order.begin(), order.end(), [&](vertex_t a, vertex_t b)
+         { return work[a] != work[b] ? work[a] > work[b] : a < b; });
+    vector<int> owner(work.size());
+    priority_queue<pair<long long, int>, vector<pair<long long, int>>, greater<pair<long long, int>>> load;
+    for (int p = 0; p < world_size; ++p)
+        load.push({0, p});
+    for (vertex_t v : order)
+    {
+        auto least = load.top();
+        load.pop();
+        owner[v] = least.second;
+        load.push({least.first + work[v], least.second});
+    }
+    return owner;
+}
+
+// Sends every edge to the owners of both endpoints, which keep full neighbor
+// lists for their centers. Centers go by map work, or round-robin with
+// `round_robin` (vertex v on rank v % world_size). Degrees and the center
+// owners are built once per node; the leader runs the bin packing.
+Graph build_graph(const vector<edge_t> &edges, int total_vertices, int rank, int world_size, bool ordered, bool round_robin,
+                  const NodeComms &nc)
+{
+    Graph g;
+    g.total_vertices = total_vertices;
+    g.degree.allocate(total_vertices, nc);
+    for (const auto &e : edges)
+    {
+        g.degree.add(e.first, 1);
+        g.degree.add(e.second, 1);
+    }
+    g.degree.sum_across_nodes();
+
+    NodeArray<int> owner;
+    owner.allocate(total_vertices, nc);
+    if (round_robin)
+    {
+        for (vertex_t v = nc.node_rank; v < total_vertices; v += nc.node_size)
+            owner[v] = v % world_size;
+    }
+    else
+    {
+        NodeArray<int> lower;
+        if (ordered)
+        {
+            lower.allocate(total_vertices, nc);
+            for (const auto &e : edges)
+            {
+                if (ranks_before(g, e.second, e.first))
+                    lower.add(e.first, 1);
+                if (ranks_before(g, e.first, e.second))
+                    lower.add(e.second, 1);
+            }
+            lower.sum_across_nodes();
+        }
+        if (nc.node_rank == 0)
+        {
+            vector<int> packed = assign_centers(center_work(g, ordered ? &lower : nullptr), world_size);
+            copy(packed.begin(), packed.end(), &owner[0]);
+        }
+    }
+    owner.sync();
+
+    vector<int> send_counts(world_size, 0);
+    for (const auto &e : edges)
+    {
+        send_counts[owner[e.first]] += 2;
+        send_counts[owner[e.second]] += 2;
+    }
+    vector<int> send_displs(world_size + 1, 0);
+    for (int p = 0; p < world_size; ++p)
+        send_displs[p + 1] = send_displs[p] + send_counts[p];
+    vector<vertex_t> send_buffer(send_displs[world_size]);
+    {
+        vector<int> pos(send_displs.begin(), send_displs.end() - 1);
+        for (const auto &e : edges)
+        {
+            int p = owner[e.first];
+            send_buffer[pos[p]++] = e.first;
+            send_buffer[pos[p]++] = e.second;
+            p = owner[e.second];
+            send_buffer[pos[p]++] = e.second;
+            send_buffer[pos[p]++] = e.first;
+        }
+    }
+    vector<int> recv_counts(world_size);
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    profiler.collective("Alltoall", world_size * sizeof(int), world_size * sizeof(int), world_size);
+    vector<int> recv_displs(world_size + 1, 0);
+    for (int p = 0; p < world_size; ++p)
+        recv_displs[p + 1] = recv_displs[p] + recv_counts[p];
+    vector<vertex_t> recv_buffer(recv_displs[world_size]);
+    MPI_Alltoallv(send_buffer.data(), send_counts.data(), send_displs.data(), MPI_INT,
+                  recv_buffer.data(), recv_counts.data(), recv_displs.data(), MPI_INT, MPI_COMM_WORLD);
+    profiler.exchange("Alltoallv", send_counts.data(), recv_counts.data(), world_size, sizeof(vertex_t));
+
+    // Owned centers in id order
+    for (vertex_t v = 0; v < total_vertices; ++v)
+    {
+        if (owner[v] == rank)
+            g.owned.push_back(v);
+    }
+    g.adj.resize(g.owned.size());
+    for (size_t i = 0; i < recv_buffer.size(); i += 2)
+        g.adj[g.local_index(recv_buffer[i])].push_back(recv_buffer[i + 1]);
+    return g;
+}
+
+// --- Incremental updates ---
+// With --updates=FILE (- for stdin) the graph and the counts stay in memory
+// after the first count, and batches of "+ u v" / "- u v" lines, ended by a
+// blank line, are applied one edge at a time. The cycles through an edge
+// (u, v) are the paths v - w - x - u with w in N(v) - u and x in N(u) - v.
+// Each batch gathers N(u) and N(v) of its endpoints on every rank with one
+// Allgatherv, and every rank follows the batch's edits on those copies; the
+// owner of each w counts |N(w) & (N(u) - v)| from its own list. The work is
+// the neighborhoods touched, not the graph. Counts move by the same
+// multiplicity as the first pass, so they stay exact. Assumes a simple graph:
+// self loops, inserts of present edges and deletes of absent ones are skipped.
+struct EdgeUpdate
+{
+    vertex_t u, v;
+    bool insert;
+};
+
+// Reads the next batch on rank 0 and broadcasts it; false at end of input
+bool next_update_batch(istream *in, int rank, string &text)
+{
+    long long len = -1;
+    if (rank == 0)
+    {
+        text.clear();
         string line;
-        while (getline(input_file, line))
+        while (getline(*in, line))
+        {
+            if (line.find_first_not_of(" \t\r") == string::npos)
+            {
+                if (text.empty())
+                    continue;
+                break;
+            }
+            text += line + "\n";
+        }
+        len = text.empty() ? -1 : (long long)text.size();
+    }
+    MPI_Bcast(&len, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+    if (len < 0)
+        return false;
+    text.resize(len);
+    MPI_Bcast(&text[0], len, MPI_CHAR, 0, MPI_COMM_WORLD);
+    profiler.bcast(sizeof(long long) + len, 0, MPI_COMM_WORLD);
+    return true;
+}
+
+// Parses a batch and resolves its names: each name's hash owner looks it up
+// in its block, an Allreduce MAX shares the ids, and names nobody knows
+// become new vertices, numbered in order of appearance on every rank alike
+vector<EdgeUpdate> parse_update_batch(const string &text, NameTable &table, int rank, int world_size)
+{
+    vector<pair<string_view, string_view>> pairs;
+    vector<bool> inserts;
+    for (size_t begin = 0, end; begin < text.size(); begin = end + 1)
+    {
+        end = text.find('\n', begin);
+        string_view line = string_view(text).substr(begin, end - begin);
+        size_t pos = 0;
+        string_view op = next_token(line, pos), u = next_token(line, pos), v = next_token(line, pos);
+        if (v.empty() || (op != "+" && op != "-"))
+        {
+            if (rank == 0)
+                cerr << "Warning: skipping update line '" << line << "'." << endl;
+            continue;
+        }
+        pairs.push_back({u, v});
+        inserts.push_back(op == "+");
+    }
+
+    unordered_map<string_view, int> index;
+    vector<string_view> batch_names;
+    for (const auto &p : pairs)
+    {
+        for (string_view name : {p.first, p.second})
+        {
+            if (index.emplace(name, (int)batch_names.size()).second)
+                batch_names.push_back(name);
+        }
+    }
+    vector<vertex_t> ids(batch_names.size(), -1);
+    for (size_t i = 0; i < batch_names.size(); ++i)
+    {
+        auto added = table.added_index.find(string(batch_names[i]));
+        if (added != table.added_index.end())
+        {
+            ids[i] = added->second;
+        }
+        else if ((int)(fnv1a(batch_names[i]) % world_size) == rank)
+        {
+            auto it = lower_bound(table.names.begin(), table.names.end(), batch_names[i]);
+            if (it != table.names.end() && *it == batch_names[i])
+                ids[i] = table.id_begin[rank] + (it - table.names.begin());
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, ids.data(), ids.size(), MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    profiler.collective("Allreduce", ids.size() * sizeof(vertex_t), ids.size() * sizeof(vertex_t), 0);
+    for (size_t i = 0; i < batch_names.size(); ++i)
+    {
+        if (ids[i] >= 0)
+            continue;
+        ids[i] = table.total();
+        table.added.push_back(string(batch_names[i]));
+        table.added_index[table.added.back()] = ids[i];
+    }
+
+    vector<EdgeUpdate> ops;
+    for (size_t i = 0; i < pairs.size(); ++i)
+        ops.push_back({ids[index[pairs[i].first]], ids[index[pairs[i].second]], inserts[i]});
+    return ops;
+}
+
+// Applies one batch in order; returns the number of edits that took effect
+long long apply_update_batch(const vector<EdgeUpdate> &ops, Graph &g, int total_vertices, count_t multiplicity,
+                             count_t &local_global_count, NodeArray<count_t> &node_per_vertex_counts, int rank, int world_size)
+{
+    // New vertices map on rank v % world_size, like round-robin centers
+    for (vertex_t v = g.total_vertices; v < total_vertices; ++v)
+    {
+        if (v % world_size == rank)
+        {
+            g.owned.push_back(v);
+            g.adj.emplace_back();
+        }
+    }
+    g.total_vertices = total_vertices;
+    if (node_per_vertex_counts.size() < (size_t)total_vertices)
+        node_per_vertex_counts.resize(total_vertices);
+
+    // Every endpoint's list, as [vertex, degree, neighbors...] from its owner
+    vector<vertex_t> endpoints;
+    for (const auto &op : ops)
+    {
+        endpoints.push_back(op.u);
+        endpoints.push_back(op.v);
+    }
+    sort(endpoints.begin(), endpoints.end());
+    endpoints.erase(unique(endpoints.begin(), endpoints.end()), endpoints.end());
+    vector<vertex_t> mine;
+    for (vertex_t x : endpoints)
+    {
+        int c = g.local_index(x);
+        if (c < 0)
+            continue;
+        mine.push_back(x);
+        mine.push_back(g.adj[c].size());
+        mine.insert(mine.end(), g.adj[c].begin(), g.adj[c].end());
+    }
+    int my_len = mine.size();
+    vector<int> lens(world_size), displs(world_size + 1, 0);
+    MPI_Allgather(&my_len, 1, MPI_INT, lens.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    for (int p = 0; p < world_size; ++p)
+        displs[p + 1] = displs[p] + lens[p];
+    vector<vertex_t> all(displs[world_size]);
+    MPI_Allgatherv(mine.data(), my_len, MPI_INT, all.data(), lens.data(), displs.data(), MPI_INT, MPI_COMM_WORLD);
+    profiler.collective("Allgatherv", my_len * sizeof(vertex_t) * (world_size - 1), all.size() * sizeof(vertex_t), world_size - 1);
+    unordered_map<vertex_t, vector<vertex_t>> nb;
+    for (size_t i = 0; i < all.size(); i += 2 + all[i + 1])
+        nb[all[i]].assign(all.begin() + i + 2, all.begin() + i + 2 + all[i + 1]);
+
+    long long applied = 0;
+    unordered_set<vertex_t> around_u;
+    for (const auto &op : ops)
+    {
+        vector<vertex_t> &nu = nb[op.u], &nv = nb[op.v];
+        bool present = find(nu.begin(), nu.end(), op.v) != nu.end();
+        if (op.u == op.v || present == op.insert)
+            continue;
+        applied++;
+
+        // Paths v - w - x - u, counted by the owners of the w
+        count_t sign = op.insert ? multiplicity : -multiplicity, paths = 0;
+        around_u.clear();
+        around_u.insert(nu.begin(), nu.end());
+        around_u.erase(op.v);
+        for (vertex_t w : nv)
         {
-            if (line.empty())
+            int c = w == op.u ? -1 : g.local_index(w);
+            if (c < 0)
                 continue;
-            stringstream ss(line);
-            string u_name, v_name;
-            ss >> u_name >> v_name;
-            if (name_to_id.find(u_name) == name_to_id.end())
+            count_t through_w = 0;
+            for (vertex_t x : g.adj[c])
+            {
+                if (around_u.count(x))
+                {
+                    through_w++;
+                    node_per_vertex_counts.add(x, sign);
+                }
+            }
+            node_per_vertex_counts.add(w, sign * through_w);
+            paths += through_w;
+        }
+        local_global_count += sign * paths;
+        node_per_vertex_counts.add(op.u, sign * paths);
+        node_per_vertex_counts.add(op.v, sign * paths);
+
+        // The edit itself, on the copies and on the owners' lists
+        for (auto [a, b] : {make_pair(op.u, op.v), make_pair(op.v, op.u)})
+        {
+            vector<vertex_t> &copy = nb[a];
+            int c = g.local_index(a);
+            if (op.insert)
             {
-                name_to_id[u_name] = next_id;
-                id_to_name[next_id] = u_name;
-                next_id++;
+                copy.push_back(b);
+                if (c >= 0)
+                    g.adj[c].push_back(b);
             }
-            if (name_to_id.find(v_name) == name_to_id.end())
+            else
             {
-                name_to_id[v_name] = next_id;
-                id_to_name[next_id] = v_name;
-                next_id++;
+                copy.erase(find(copy.begin(), copy.end(), b));
+                if (c >= 0)
+                    g.adj[c].erase(find(g.adj[c].begin(), g.adj[c].end(), b));
             }
-            all_edges.push_back({name_to_id[u_name], name_to_id[v_name]});
         }
-        total_vertices = next_id;
     }
+    return applied;
+}
+
+// --- Output ---
+// Every rank formats the vertices whose names it owns. Results go to stdout
+// through one Gatherv, or with --output=FILE each rank writes its own slice
+// of the file at an offset from an Exscan of the slice lengths.
+using ranked_t = pair<count_t, string>; // (count, name)
+
+// Most cycles first, then by name
+inline bool ranks_higher(const ranked_t &a, const ranked_t &b)
+{
+    return a.first != b.first ? a.first > b.first : a.second < b.second;
+}
 
-    // Broadcast setup data
-    MPI_Bcast(&total_vertices, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    long long num_edges = all_edges.size();
-    MPI_Bcast(&num_edges, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
-    if (rank != 0)
-        all_edges.resize(num_edges);
-    MPI_Bcast(all_edges.data(), num_edges * sizeof(edge_t), MPI_BYTE, 0, MPI_COMM_WORLD);
+void keep_top(vector<ranked_t> &list, size_t k)
+{
+    size_t n = min(k, list.size());
+    partial_sort(list.begin(), list.begin() + n, list.end(), ranks_higher);
+    list.resize(n);
+}
 
-    // --- Steps 2, 3, 4, 5 (Map, Shuffle, Reduce for Wedges) are unchanged ---
-    vector<vector<vertex_t>> adj(total_vertices);
-    for (const auto &edge : all_edges)
+// Distributed top-k: each rank trims its own counts to k, then a binomial
+// tree merges the lists pairwise toward rank 0 in log2(ranks) steps, so no
+// rank ever holds more than 2k candidates. The result is valid on rank 0.
+vector<ranked_t> top_k(vector<ranked_t> mine, size_t k, int rank, int world_size)
+{
+    keep_top(mine, k);
+    for (int step = 1; step < world_size; step <<= 1)
     {
-        adj[edge.first].push_back(edge.second);
-        adj[edge.second].push_back(edge.first);
+        if (rank % (2 * step) == step)
+        {
+            string text;
+            for (const auto &entry : mine)
+                text += to_string(entry.first) + "\t" + entry.second + "\n";
+            MPI_Send(text.data(), text.size(), MPI_CHAR, rank - step, 0, MPI_COMM_WORLD);
+            profiler.collective("Send", text.size(), 0, 1);
+            break;
+        }
+        if (rank % (2 * step) == 0 && rank + step < world_size)
+        {
+            MPI_Status status;
+            int len;
+            MPI_Probe(rank + step, 0, MPI_COMM_WORLD, &status);
+            MPI_Get_count(&status, MPI_CHAR, &len);
+            string text(len, '\0');
+            MPI_Recv(&text[0], len, MPI_CHAR, rank + step, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            profiler.collective("Recv", 0, len, 0);
+            for (size_t begin = 0, tab, end; begin < text.size(); begin = end + 1)
+            {
+                tab = text.find('\t', begin);
+                end = text.find('\n', tab);
+                mine.push_back({stoll(text.substr(begin, tab - begin)), text.substr(tab + 1, end - tab - 1)});
+            }
+            keep_top(mine, k);
+        }
     }
-    map<int, vector<wedge_t>> wedges_to_send;
-    map_job1(rank, world_size, total_vertices, adj, wedges_to_send);
+    return mine;
+}
 
-    // Shuffle wedges
-    vector<int> send_counts_w(world_size, 0);
-    for (auto const &[dest, wedges] : wedges_to_send)
+// Writes every rank's `mine` back to back, in rank order, into `path` (collective)
+void write_ranked_slices(const string &path, const string &mine, int rank)
+{
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS)
     {
-        send_counts_w[dest] = wedges.size() * sizeof(wedge_t);
+        if (rank == 0)
+            cerr << "Error: could not create " << path << "." << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
-    vector<int> recv_counts_w(world_size, 0);
-    MPI_Alltoall(send_counts_w.data(), 1, MPI_INT, recv_counts_w.data(), 1, MPI_INT, MPI_COMM_WORLD);
-    vector<char> send_buffer_w;
-    vector<int> send_displs_w(world_size + 1, 0);
-    for (int i = 0; i < world_size; ++i)
+    long long len = mine.size(), offset = 0, total = 0;
+    MPI_Exscan(&len, &offset, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0)
+        offset = 0;
+    MPI_Allreduce(&len, &total, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    profiler.collective("Exscan", sizeof(long long), sizeof(long long), 0);
+    MPI_File_set_size(fh, total);
+    for (long long done = 0; done < len;)
+    {
+        int chunk = (int)min<long long>(len - done, 1 << 30);
+        MPI_File_write_at(fh, offset + done, mine.data() + done, chunk, MPI_CHAR, MPI_STATUS_IGNORE);
+        done += chunk;
+    }
+    profiler.collective("File_write_at", len, 0, 0);
+    MPI_File_close(&fh);
+}
+
+// Per-rank map and reduce load, gathered on rank 0 for the work summary
+struct RankWork
+{
+    double centers, wedges_mapped, records_reduced, map_seconds, reduce_seconds;
+};
+
+// One row per rank, then max / mean of every column
+void print_work_summary(const vector<RankWork> &work)
+{
+    const int columns = sizeof(RankWork) / sizeof(double);
+    vector<double> max_of(columns, 0), sum_of(columns, 0);
+    cerr << "--- WORK SUMMARY ---" << endl;
+    cerr << "RANK\tCENTERS\tWEDGES_MAPPED\tRECORDS_REDUCED\tMAP_TIME\tREDUCE_TIME" << endl;
+    for (size_t p = 0; p < work.size(); ++p)
     {
-        send_displs_w[i + 1] = send_displs_w[i] + send_counts_w[i];
-        if (wedges_to_send.count(i))
+        const double *row = &work[p].centers;
+        cerr << p;
+        for (int c = 0; c < columns; ++c)
         {
-            const auto &wedges = wedges_to_send[i];
-            send_buffer_w.insert(send_buffer_w.end(), (char *)wedges.data(), (char *)wedges.data() + wedges.size() * sizeof(wedge_t));
+            cerr << "\t" << row[c];
+            max_of[c] = max(max_of[c], row[c]);
+            sum_of[c] += row[c];
         }
+        cerr << endl;
     }
-    vector<int> recv_displs_w(world_size + 1, 0);
-    for (int i = 0; i < world_size; ++i)
-        recv_displs_w[i + 1] = recv_displs_w[i] + recv_counts_w[i];
-    vector<char> recv_buffer_w(recv_displs_w[world_size]);
-    MPI_Alltoallv(send_buffer_w.data(), send_counts_w.data(), send_displs_w.data(), MPI_BYTE, recv_buffer_w.data(), recv_counts_w.data(), recv_displs_w.data(), MPI_BYTE, MPI_COMM_WORLD);
-    vector<wedge_t> received_wedges((wedge_t *)recv_buffer_w.data(), (wedge_t *)(recv_buffer_w.data() + recv_buffer_w.size()));
+    cerr << "IMBALANCE";
+    for (int c = 0; c < columns; ++c)
+        cerr << "\t" << (sum_of[c] > 0 ? max_of[c] * work.size() / sum_of[c] : 1.0);
+    cerr << endl;
+}
 
+// bench/kernels.cpp includes this file with Q2_NO_MAIN to time the kernels above
+#ifndef Q2_NO_MAIN
+int main(int argc, char *argv[])
+{
+    // freopen("output.txt", "w", stdout); // file output.txt is opened in writing mode i.e "w"
+    // freopen("bench.txt", "w", stderr);  // file output.txt is opened in writing mode i.e "w"
+    MPI_Init(&argc, &argv);
+    int rank, world_size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+
+    if (world_size < 2)
+    { /* Error handling */
+    }
+
+    // --header skips a leading "n m" line instead of reading it as an edge,
+    // --ordered enumerates only degree-ordered wedges (same counts, fewer wedges),
+    // --shuffle-mem=MB caps each rank's wedge buffers (the shuffle runs in rounds),
+    // --combine pre-aggregates wedges per pair on the map side,
+    // --centers=rr assigns centers round-robin instead of by map work,
+    // --split-heavy spreads the wedges of very heavy pairs over all reducers,
+    // --output=FILE writes the results with MPI-IO instead of stdout,
+    // --top-k=K reports only the K vertices on the most cycles,
+    // --updates=FILE|- then applies batches of edge edits incrementally,
+    // --compress sends wedges and per-vertex counts as delta/varint streams,
+    // --profile[=FILE] emits per-phase times and traffic as one JSON line
+    string profile_path, output_path, updates_path;
+    long long top = 0;
+    bool header = false, ordered = false, combine = false, round_robin = false, split_heavy = false;
+    long long shuffle_mem = 1024LL << 20;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--header") == 0)
+            header = true;
+        else if (strcmp(argv[i], "--ordered") == 0)
+            ordered = true;
+        else if (strcmp(argv[i], "--combine") == 0)
+            combine = true;
+        else if (strcmp(argv[i], "--centers=rr") == 0)
+            round_robin = true;
+        else if (strcmp(argv[i], "--split-heavy") == 0)
+            split_heavy = true;
+        else if (strncmp(argv[i], "--output=", 9) == 0)
+            output_path = argv[i] + 9;
+        else if (strncmp(argv[i], "--updates=", 10) == 0)
+            updates_path = argv[i] + 10;
+        else if (strncmp(argv[i], "--top-k=", 8) == 0)
+            top = max(1LL, atoll(argv[i] + 8));
+        else if (strncmp(argv[i], "--shuffle-mem=", 14) == 0)
+            shuffle_mem = max(1LL, atoll(argv[i] + 14)) << 20;
+        else if (strcmp(argv[i], "--compress") == 0)
+            wire_codec.enable();
+        else if (strcmp(argv[i], "--profile") == 0)
+            profiler.enable();
+        else if (strncmp(argv[i], "--profile=", 10) == 0)
+        {
+            profiler.enable();
+            profile_path = argv[i] + 10;
+        }
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start_time = MPI_Wtime();
+    profiler.phase("read");
+
+    // --- Step 1: Every rank reads and interns its own slice of the edge list ---
+    bool first_line;
+    string my_text = read_my_lines("input.txt", rank, world_size, first_line);
+    vector<name_pair_t> name_pairs = parse_edge_lines(my_text);
+    if (header)
+        drop_header_line(name_pairs, first_line);
+
+    profiler.phase("intern");
+    NameTable names;
+    vector<edge_t> my_edges = intern_names(name_pairs, rank, world_size, names);
+    name_pairs.clear();
+    int total_vertices = names.total();
+
+    profiler.phase("distribute");
+    NodeComms node_comms = make_node_comms(rank);
+    Graph graph = build_graph(my_edges, total_vertices, rank, world_size, ordered, round_robin, node_comms);
+    my_edges.clear();
+
+    profiler.phase("map");
+    if (ordered)
+    {
+        sort_adjacency_by_rank(graph);
+        if (has_repeated_edges(graph))
+        {
+            if (rank == 0)
+                cerr << "Warning: the input has repeated edges or self loops; --ordered falls back to all wedges." << endl;
+            ordered = false;
+        }
+    }
+    // Unordered mode finds every cycle twice, ordered mode once
+    const count_t multiplicity = ordered ? 1 : 2;
+
+    // Map, shuffle and reduce wedges round by round
+    profiler.phase("shuffle");
+    // The combiner sums each pair on one reducer, so it never splits pairs;
+    // it already sends at most one record per pair and rank
+    HeavyPairs heavy;
+    if (split_heavy && !combine)
+        heavy = find_heavy_pairs(graph, ordered, world_size);
+    long long map_work = count_wedges(graph, ordered);
+    int rounds = shuffle_rounds(map_work, shuffle_mem);
     count_t local_global_count = 0;
-    map<vertex_t, count_t> local_per_vertex_counts;
-    reduce_jobs_2_and_3(received_wedges, local_global_count, local_per_vertex_counts);
+    NodeArray<count_t> node_per_vertex_counts;
+    node_per_vertex_counts.allocate(total_vertices, node_comms);
+    WedgeShuffle shuffle(rank, world_size, graph, heavy, ordered, combine, rounds);
+    shuffle.run(local_global_count, node_per_vertex_counts);
+    long long wedges_emitted = shuffle.wedges_sent, total_wedges = 0;
+    // Bytes the plain shuffle would move, and what was actually moved
+    long long shuffle_bytes[2] = {wedges_emitted * (long long)sizeof(wedge_t),
+                                  shuffle.records_sent * (long long)sizeof(wedge_t) + shuffle.reply_bytes};
+    long long total_shuffle_bytes[2] = {0, 0};
+    profiler.count("wedges_sent", wedges_emitted);
+    profiler.count("wedges_received", shuffle.wedges_received);
 
-    // --- Step 6: Shuffle and Aggregate Per-Vertex Counts ---
+    // --- Incremental updates, one batch at a time ---
+    if (!updates_path.empty())
+    {
+        profiler.phase("update");
+        ifstream update_file;
+        istream *updates = &cin;
+        if (rank == 0 && updates_path != "-")
+        {
+            update_file.open(updates_path);
+            if (!update_file.is_open())
+            {
+                cerr << "Error: could not open " << updates_path << "." << endl;
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            updates = &update_file;
+        }
+        string batch;
+        for (int b = 1; next_update_batch(updates, rank, batch); ++b)
+        {
+            double batch_start = MPI_Wtime();
+            vector<EdgeUpdate> ops = parse_update_batch(batch, names, rank, world_size);
+            total_vertices = names.total();
+            long long applied = apply_update_batch(ops, graph, total_vertices, multiplicity, local_global_count, node_per_vertex_counts, rank, world_size);
+            count_t batch_count = 0;
+            MPI_Reduce(&local_global_count, &batch_count, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+            if (rank == 0)
+            {
+                cerr << "UPDATE_BATCH: " << b << "\tEDITS: " << applied << "/" << ops.size()
+                     << "\tGLOBAL_COUNT: " << batch_count / multiplicity << "\tTIME: " << MPI_Wtime() - batch_start << endl;
+            }
+        }
+    }
+
+    // --- Step 6: Shuffle Per-Vertex Counts to the owners of the names ---
+    // The node's ranks have already combined their counts in shared memory;
+    // each sends its stripe of the node array, so every count leaves a node once
+    profiler.phase("aggregate");
+    node_per_vertex_counts.sync();
     map<int, vector<pvc_pair_t>> counts_to_send;
-    hash<vertex_t> hasher;
-    for (const auto &pair : local_per_vertex_counts)
+    for (vertex_t v = node_comms.node_rank; v < total_vertices; v += node_comms.node_size)
     {
-        int dest_rank = hasher(pair.first) % world_size;
-        counts_to_send[dest_rank].push_back({pair.first, pair.second});
+        if (node_per_vertex_counts[v] == 0)
+            continue;
+        int dest_rank = names.owner(v);
+        counts_to_send[dest_rank].push_back({v, node_per_vertex_counts[v]});
     }
 
+    // --compress encodes each destination's pairs up front; counts are bytes either way
     vector<int> send_counts_pvc(world_size, 0);
+    vector<vector<char>> encoded_pvc(wire_codec.on() ? world_size : 0);
+    double encode_start = MPI_Wtime();
+    long long raw_pvc_bytes = 0;
     for (auto const &[dest, pairs] : counts_to_send)
     {
         send_counts_pvc[dest] = pairs.size() * sizeof(pvc_pair_t);
+        if (wire_codec.on())
+        {
+            encode_vertex_counts(encoded_pvc[dest], pairs);
+            raw_pvc_bytes += send_counts_pvc[dest];
+            send_counts_pvc[dest] = encoded_pvc[dest].size();
+        }
     }
     vector<int> recv_counts_pvc(world_size, 0);
     MPI_Alltoall(send_counts_pvc.data(), 1, MPI_INT, recv_counts_pvc.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    profiler.collective("Alltoall", world_size * sizeof(int), world_size * sizeof(int), world_size);
 
     vector<char> send_buffer_pvc;
     vector<int> send_displs_pvc(world_size + 1, 0);
     for (int i = 0; i < world_size; ++i)
     {
         send_displs_pvc[i + 1] = send_displs_pvc[i] + send_counts_pvc[i];
-        if (counts_to_send.count(i))
+        if (wire_codec.on())
+        {
+            send_buffer_pvc.insert(send_buffer_pvc.end(), encoded_pvc[i].begin(), encoded_pvc[i].end());
+        }
+        else if (counts_to_send.count(i))
         {
             const auto &pairs = counts_to_send[i];
             send_buffer_pvc.insert(send_buffer_pvc.end(), (char *)pairs.data(), (char *)pairs.data() + pairs.size() * sizeof(pvc_pair_t));
         }
     }
+    if (wire_codec.on())
+        wire_codec.encoded("vertex_counts", raw_pvc_bytes, send_buffer_pvc.size(), MPI_Wtime() - encode_start);
     vector<int> recv_displs_pvc(world_size + 1, 0);
     for (int i = 0; i < world_size; ++i)
         recv_displs_pvc[i + 1] = recv_displs_pvc[i] + recv_counts_pvc[i];
@@ -205,85 +1849,117 @@ int main(int argc, char *argv[])
     MPI_Alltoallv(send_buffer_pvc.data(), send_counts_pvc.data(), send_displs_pvc.data(), MPI_BYTE,
                   recv_buffer_pvc.data(), recv_counts_pvc.data(), recv_displs_pvc.data(), MPI_BYTE,
                   MPI_COMM_WORLD);
+    profiler.exchange("Alltoallv", send_counts_pvc.data(), recv_counts_pvc.data(), world_size, 1);
 
-    vector<pvc_pair_t> received_counts((pvc_pair_t *)recv_buffer_pvc.data(), (pvc_pair_t *)(recv_buffer_pvc.data() + recv_buffer_pvc.size()));
+    vector<pvc_pair_t> received_counts;
+    if (wire_codec.on())
+    {
+        double decode_start = MPI_Wtime();
+        for (int i = 0; i < world_size; ++i)
+            decode_vertex_counts(recv_buffer_pvc.data() + recv_displs_pvc[i], recv_counts_pvc[i], received_counts);
+        wire_codec.decoded("vertex_counts", MPI_Wtime() - decode_start);
+    }
+    else
+    {
+        received_counts.assign((pvc_pair_t *)recv_buffer_pvc.data(), (pvc_pair_t *)(recv_buffer_pvc.data() + recv_buffer_pvc.size()));
+    }
     map<vertex_t, count_t> final_per_vertex_counts;
     for (const auto &pair : received_counts)
     {
         final_per_vertex_counts[pair.first] += pair.second;
     }
+    // Updates can cancel a vertex's partial counts out
+    for (auto it = final_per_vertex_counts.begin(); it != final_per_vertex_counts.end();)
+        it = it->second == 0 ? final_per_vertex_counts.erase(it) : next(it);
 
     // --- Step 7: Final Aggregation and Reporting ---
+    profiler.phase("output");
     count_t final_global_count = 0;
     MPI_Reduce(&local_global_count, &final_global_count, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&wedges_emitted, &total_wedges, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(shuffle_bytes, total_shuffle_bytes, 2, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
 
     MPI_Barrier(MPI_COMM_WORLD);
     double end_time = MPI_Wtime();
 
+    // Each rank formats its own vertices (or, with --top-k, rank 0 the winners)
+    string my_lines;
+    auto add_line = [&](const string &name, count_t count)
+    {
+        my_lines += "Per-Vertex_Count\t";
+        my_lines += name;
+        my_lines += "\t" + to_string(count) + "\n";
+    };
     if (rank == 0)
+        my_lines = "\n========== FINAL RESULTS ==========\nGlobal_Count\t4-Cycles\t" + to_string(final_global_count / multiplicity) + "\n";
+    if (top > 0)
     {
-        final_global_count /= 2;
-
-        // Gather all per-vertex counts to rank 0 for printing
-        // This is a simplified gather. For huge numbers of vertices, another approach is needed.
-        // But for typical graphs, this is fine.
-        int local_pvc_size = final_per_vertex_counts.size();
-        vector<int> all_pvc_sizes(world_size);
-        MPI_Gather(&local_pvc_size, 1, MPI_INT, all_pvc_sizes.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
-
-        vector<pvc_pair_t> final_pvc_results;
+        vector<ranked_t> mine;
+        mine.reserve(final_per_vertex_counts.size());
         for (const auto &pair : final_per_vertex_counts)
+            mine.push_back({pair.second / multiplicity, names.name_of(pair.first)});
+        vector<ranked_t> best = top_k(move(mine), top, rank, world_size);
+        if (rank == 0)
         {
-            final_pvc_results.push_back(pair);
+            for (const auto &entry : best)
+                add_line(entry.second, entry.first);
         }
+    }
+    else
+    {
+        for (const auto &pair : final_per_vertex_counts)
+            add_line(names.name_of(pair.first), pair.second / multiplicity);
+    }
+    if (rank == world_size - 1)
+        my_lines += "===================================\n";
 
-        for (int i = 1; i < world_size; ++i)
+    if (!output_path.empty())
+    {
+        write_ranked_slices(output_path, my_lines, rank);
+    }
+    else
+    {
+        int my_len = my_lines.size();
+        vector<int> line_lens(world_size), line_displs(world_size + 1, 0);
+        MPI_Gather(&my_len, 1, MPI_INT, line_lens.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (rank == 0)
         {
-            if (all_pvc_sizes[i] > 0)
-            {
-                vector<pvc_pair_t> temp_buffer(all_pvc_sizes[i]);
-                MPI_Recv(temp_buffer.data(), all_pvc_sizes[i] * sizeof(pvc_pair_t), MPI_BYTE, i, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-                final_pvc_results.insert(final_pvc_results.end(), temp_buffer.begin(), temp_buffer.end());
-            }
+            for (int p = 0; p < world_size; ++p)
+                line_displs[p + 1] = line_displs[p] + line_lens[p];
         }
+        vector<char> all_lines(rank == 0 ? line_displs[world_size] : 0);
+        MPI_Gatherv(my_lines.data(), my_len, MPI_CHAR, all_lines.data(), line_lens.data(), line_displs.data(), MPI_CHAR, 0, MPI_COMM_WORLD);
+        profiler.collective("Gatherv", rank == 0 ? 0 : my_len, all_lines.size(), rank != 0 && my_len > 0);
+        if (rank == 0)
+            cout.write(all_lines.data(), all_lines.size()).flush();
+    }
 
-        // Reporting
-        double max_time;
-        double elapsed_time = end_time - start_time;
-        MPI_Reduce(&elapsed_time, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-
-        cout << "\n========== FINAL RESULTS ==========" << endl;
-        cout << "Global_Count\t4-Cycles\t" << final_global_count << endl;
-        for (const auto &pair : final_pvc_results)
-        {
-            cout << "Per-Vertex_Count\t" << id_to_name[pair.first] << "\t" << (pair.second / 2) << endl;
-        }
-        cout << "===================================" << endl;
+    double max_time, elapsed_time = end_time - start_time;
+    MPI_Reduce(&elapsed_time, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    RankWork my_work = {(double)graph.owned.size(), (double)shuffle.wedges_sent, (double)shuffle.wedges_received,
+                        shuffle.map_seconds, shuffle.reduce_seconds};
+    vector<RankWork> all_work(rank == 0 ? world_size : 0);
+    MPI_Gather(&my_work, sizeof(RankWork), MPI_BYTE, all_work.data(), sizeof(RankWork), MPI_BYTE, 0, MPI_COMM_WORLD);
 
+    if (rank == 0)
+    {
         cerr << "--- BENCHMARK DATA ---" << endl;
         cerr << "CORES: " << world_size << endl;
         cerr << "TOTAL_TIME: " << max_time << endl;
-    }
-    else
-    {
-        // Workers participate in reductions and send final PVC to master
-        double elapsed_time = end_time - start_time;
-        MPI_Reduce(&elapsed_time, nullptr, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
-
-        int local_pvc_size = final_per_vertex_counts.size();
-        MPI_Gather(&local_pvc_size, 1, MPI_INT, nullptr, 0, MPI_INT, 0, MPI_COMM_WORLD);
-
-        if (local_pvc_size > 0)
-        {
-            vector<pvc_pair_t> pvc_to_send;
-            for (const auto &pair : final_per_vertex_counts)
-            {
-                pvc_to_send.push_back(pair);
-            }
-            MPI_Send(pvc_to_send.data(), pvc_to_send.size() * sizeof(pvc_pair_t), MPI_BYTE, 0, 0, MPI_COMM_WORLD);
-        }
+        cerr << "WEDGE_MODE: " << (ordered ? "ordered" : "all") << endl;
+        cerr << "WEDGES_EMITTED: " << total_wedges << endl;
+        cerr << "SHUFFLE_ROUNDS: " << rounds << endl;
+        cerr << "SHUFFLE_BYTES_UNCOMBINED: " << total_shuffle_bytes[0] << endl;
+        if (combine)
+            cerr << "SHUFFLE_BYTES_COMBINED: " << total_shuffle_bytes[1] << endl;
+        if (!heavy.keys.empty())
+            cerr << "HEAVY_PAIRS_SPLIT: " << heavy.keys.size() << endl;
+        print_work_summary(all_work);
     }
 
+    wire_codec.report({"wedges", "vertex_counts"});
+    profiler.report("q2", profile_path);
     MPI_Finalize();
     return 0;
 }
+#endif
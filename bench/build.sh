@@ -0,0 +1,15 @@
+#!/bin/bash
+# Builds the kernel microbenchmarks and the programs the scaling driver runs
+# into bench/bin. Extra arguments go to every compile (e.g. -march=native).
+#
+#   bench/build.sh [CXXFLAGS...]
+set -e
+cd "$(dirname "$0")"
+mkdir -p bin
+FLAGS="-O3 -std=c++17 -pthread $*"
+
+mpic++ $FLAGS kernels.cpp -o bin/kernels
+mpic++ $FLAGS ../MPI/q1.cpp -o bin/q1
+mpic++ $FLAGS ../Map-Reduce/q2.cpp -o bin/q2
+g++ $FLAGS ../Map-Reduce/generate.cpp -o bin/generate
+echo "built: $(ls bin | tr '\n' ' ')"
@@ -0,0 +1,258 @@
+// Microbenchmarks for the hot kernels of q1 and q2, on synthetic inputs:
+//
+//   spgemm_rows    q1's per-row accumulation (symbolic + numeric pass of
+//                  multiply) with the hash, dense and adaptive accumulators
+//   wedge_gen      q2's mappers (all wedges and degree-ordered) into a buffer
+//   wedge_group    q2's reducer: radix sort + run scan, and std::sort for scale
+//
+// Runs single-process (MPI singleton init, needed for q2's node-shared arrays).
+//
+//   ./kernels [--reps=R] [--warmup=W] [--scale=F] [--filter=SUBSTR] [--json]
+//
+// Every case runs W untimed and R timed repetitions and prints one row:
+// kernel, variant, items per repetition (flops or wedges), median and p95
+// time, and items per second at the median. --scale multiplies the input
+// sizes; --filter keeps the cases whose "kernel/variant" contains SUBSTR.
+#include <bits/stdc++.h>
+#include "../MPI/spgemm.h"
+#define Q2_NO_MAIN
+#include "../Map-Reduce/q2.cpp"
+using namespace std;
+
+struct BenchOptions {
+    int reps = 10, warmup = 2;
+    double scale = 1.0;
+    string filter;
+    bool json = false;
+};
+
+struct Result {
+    string kernel, variant;
+    long long items;
+    vector<double> seconds;  // sorted
+};
+
+// Nearest-rank percentile of sorted samples
+double percentile(const vector<double>& sorted, double p) {
+    size_t i = (size_t)ceil(p * sorted.size());
+    return sorted[min(sorted.size() - 1, i > 0 ? i - 1 : 0)];
+}
+
+// Runs setup() then fn() warmup + reps times; only fn() is timed
+template <class Setup, class Fn>
+vector<double> time_runs(const BenchOptions& opt, Setup setup, Fn fn) {
+    vector<double> samples;
+    for (int r = 0; r < opt.warmup + opt.reps; r++) {
+        setup();
+        auto start = chrono::steady_clock::now();
+        fn();
+        double s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (r >= opt.warmup) samples.push_back(s);
+    }
+    sort(samples.begin(), samples.end());
+    return samples;
+}
+
+void print_result(const Result& r, const BenchOptions& opt, bool first) {
+    double median = percentile(r.seconds, 0.5), p95 = percentile(r.seconds, 0.95);
+    double rate = median > 0 ? r.items / median : 0;
+    if (opt.json) {
+        printf("%s{\"kernel\":\"%s\",\"variant\":\"%s\",\"items\":%lld,\"reps\":%zu,"
+               "\"median_ms\":%.4f,\"p95_ms\":%.4f,\"items_per_s\":%.4g}",
+               first ? "[" : ",\n ", r.kernel.c_str(), r.variant.c_str(), r.items, r.seconds.size(),
+               median * 1e3, p95 * 1e3, rate);
+    } else {
+        if (first) printf("kernel,variant,items,reps,median_ms,p95_ms,items_per_s\n");
+        printf("%s,%s,%lld,%zu,%.4f,%.4f,%.4g\n", r.kernel.c_str(), r.variant.c_str(), r.items, r.seconds.size(),
+               median * 1e3, p95 * 1e3, rate);
+    }
+    fflush(stdout);
+}
+
+// --- Inputs ---
+struct Xorshift {
+    uint64_t s;
+    explicit Xorshift(uint64_t seed) : s(seed * 0x9e3779b97f4a7c15ULL + 1) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+    int below(int n) { return (int)((next() >> 32) * (uint64_t)n >> 32); }
+};
+
+// rows x cols with `per_row` random entries per row, values in 1..9
+CSR random_csr(int rows, int cols, int per_row, uint64_t seed) {
+    Xorshift rng(seed);
+    CSR m;
+    m.rows = rows;
+    m.cols = cols;
+    m.row_ptr.assign(rows + 1, 0);
+    vector<int> row;
+    for (int i = 0; i < rows; i++) {
+        row.clear();
+        for (int k = 0; k < per_row; k++) row.push_back(rng.below(cols));
+        sort(row.begin(), row.end());
+        row.erase(unique(row.begin(), row.end()), row.end());
+        for (int c : row) {
+            m.col.push_back(c);
+            m.val.push_back(1 + rng.below(9));
+        }
+        m.row_ptr[i + 1] = m.col.size();
+    }
+    return m;
+}
+
+// Simple graph with skewed degrees: endpoints drawn as V * u^2, so low ids
+// are hubs, as in the power-law inputs the degree ordering is meant for
+vector<edge_t> skewed_edges(int vertices, long long edges, uint64_t seed) {
+    Xorshift rng(seed);
+    auto pick = [&]() {
+        double u = (rng.next() >> 11) * 0x1.0p-53;
+        return min(vertices - 1, (int)(vertices * u * u));
+    };
+    vector<uint64_t> keys;
+    keys.reserve(edges);
+    while ((long long)keys.size() < edges) {
+        int a = pick(), b = rng.below(vertices);
+        if (a != b) keys.push_back(pair_key(min(a, b), max(a, b)));
+    }
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    vector<edge_t> out;
+    for (uint64_t k : keys) out.push_back({(vertex_t)(k >> 32), (vertex_t)(k & 0xffffffffu)});
+    return out;
+}
+
+// The whole graph as one rank's share: every vertex is an owned center
+Graph single_rank_graph(const vector<edge_t>& edges, int vertices, const NodeComms& nc) {
+    Graph g;
+    g.total_vertices = vertices;
+    g.degree.allocate(vertices, nc);
+    g.owned.resize(vertices);
+    iota(g.owned.begin(), g.owned.end(), 0);
+    g.adj.resize(vertices);
+    for (const auto& e : edges) {
+        g.adj[e.first].push_back(e.second);
+        g.adj[e.second].push_back(e.first);
+        g.degree[e.first]++;
+        g.degree[e.second]++;
+    }
+    return g;
+}
+
+// --- Cases ---
+bool wanted(const BenchOptions& opt, const string& kernel, const string& variant) {
+    return opt.filter.empty() || (kernel + "/" + variant).find(opt.filter) != string::npos;
+}
+
+// Hash-only, dense-only and the adaptive default, on a sparse product (short
+// output rows over a wide P) and a dense one (rows fill a narrow P). Dense-only
+// is skipped on the sparse shape, where every row would scan all P flags.
+void bench_spgemm(const BenchOptions& opt, vector<Result>& results) {
+    struct Shape {
+        const char* name;
+        int n, m, p, per_row;
+    };
+    int n = max(1, (int)(20000 * opt.scale));
+    Shape shapes[] = {{"sparse", n, n, 1 << 20, 8}, {"dense", n / 8, 2048, 2048, 48}};
+    KernelTuning saved = kernel_tuning;
+    for (const Shape& s : shapes) {
+        CSR A = random_csr(s.n, s.m, s.per_row, 1), B = random_csr(s.m, s.p, s.per_row, 2);
+        long long flops = range_flops(A, B, 0, A.nnz());
+        for (const char* variant : {"hash", "dense", "adaptive"}) {
+            string name = string(variant) + "_" + s.name;
+            bool pathological = strcmp(variant, "dense") == 0 && strcmp(s.name, "sparse") == 0;
+            if (pathological || !wanted(opt, "spgemm_rows", name)) continue;
+            kernel_tuning = saved;
+            if (strcmp(variant, "hash") == 0) kernel_tuning.dense_min_flops = LLONG_MAX;
+            if (strcmp(variant, "dense") == 0) {
+                kernel_tuning.dense_min_flops = 0;
+                kernel_tuning.dense_min_density = 0;
+            }
+            RowBlock C;
+            auto samples = time_runs(opt, [] {}, [&] { C = multiply(A, B, s.p, 0, A.nnz(), 0); });
+            results.push_back({"spgemm_rows", name, flops, samples});
+        }
+    }
+    kernel_tuning = saved;
+}
+
+void bench_wedges(const BenchOptions& opt, vector<Result>& results, const NodeComms& nc) {
+    int vertices = max(16, (int)(50000 * opt.scale));
+    Graph g = single_rank_graph(skewed_edges(vertices, 4LL * vertices, 3), vertices, nc);
+    Graph ordered_g = single_rank_graph(skewed_edges(vertices, 4LL * vertices, 3), vertices, nc);
+    sort_adjacency_by_rank(ordered_g);
+
+    vector<wedge_t> wedges;
+    for (bool ordered : {false, true}) {
+        const Graph& graph = ordered ? ordered_g : g;
+        long long count = count_wedges(graph, ordered);
+        wedges.reserve(count);
+        auto emit = [&](vertex_t v1, vertex_t v2, vertex_t c) { wedges.push_back({pair_key(v1, v2), c}); };
+        string name = ordered ? "ordered" : "all";
+        if (wanted(opt, "wedge_gen", name)) {
+            auto samples = time_runs(opt, [&] { wedges.clear(); }, [&] {
+                if (ordered) map_job1_ordered(graph, emit);
+                else map_job1(graph, emit);
+            });
+            results.push_back({"wedge_gen", name, count, samples});
+        }
+    }
+
+    // Grouping runs on the unordered wedges, in mapper order
+    wedges.clear();
+    map_job1(g, [&](vertex_t v1, vertex_t v2, vertex_t c) { wedges.push_back({pair_key(v1, v2), c}); });
+    vector<wedge_t> work;
+    if (wanted(opt, "wedge_group", "radix_reduce")) {
+        NodeArray<count_t> counts;
+        counts.allocate(vertices, nc);
+        HeavyPairs no_heavy;
+        vector<count_t> heavy_k;
+        vector<pvc_pair_t> heavy_centers;
+        count_t total = 0;
+        auto samples = time_runs(opt, [&] { work = wedges; },
+                                 [&] { reduce_jobs_2_and_3(work, total, counts, no_heavy, heavy_k, heavy_centers); });
+        results.push_back({"wedge_group", "radix_reduce", (long long)wedges.size(), samples});
+    }
+    if (wanted(opt, "wedge_group", "radix_sort")) {
+        auto samples = time_runs(opt, [&] { work = wedges; }, [&] { radix_sort_wedges(work); });
+        results.push_back({"wedge_group", "radix_sort", (long long)wedges.size(), samples});
+    }
+    if (wanted(opt, "wedge_group", "std_sort")) {
+        auto samples = time_runs(opt, [&] { work = wedges; }, [&] {
+            sort(work.begin(), work.end(), [](const wedge_t& a, const wedge_t& b) { return a.key < b.key; });
+        });
+        results.push_back({"wedge_group", "std_sort", (long long)wedges.size(), samples});
+    }
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(&argc, &argv);
+    BenchOptions opt;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--reps=", 7) == 0) opt.reps = max(1, atoi(argv[i] + 7));
+        else if (strncmp(argv[i], "--warmup=", 9) == 0) opt.warmup = max(0, atoi(argv[i] + 9));
+        else if (strncmp(argv[i], "--scale=", 8) == 0) opt.scale = atof(argv[i] + 8);
+        else if (strncmp(argv[i], "--filter=", 9) == 0) opt.filter = argv[i] + 9;
+        else if (strcmp(argv[i], "--json") == 0) opt.json = true;
+        else {
+            fprintf(stderr, "usage: %s [--reps=R] [--warmup=W] [--scale=F] [--filter=SUBSTR] [--json]\n", argv[0]);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    {
+        NodeComms nc = make_node_comms(rank);
+        vector<Result> results;
+        bench_spgemm(opt, results);
+        bench_wedges(opt, results, nc);
+        for (size_t i = 0; i < results.size(); i++) print_result(results[i], opt, i == 0);
+        if (opt.json) printf(results.empty() ? "[]\n" : "]\n");
+    }
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""Local strong/weak scaling runs of q1 and q2 under mpirun (no Slurm).
+
+For every program, mode, input size and rank count it runs `--warmup` untimed
+and `--repeats` timed runs. The time of a run is the slowest rank's
+wall time from the program's --profile report, so mpirun startup is left out.
+It writes one CSV row per point plus the same records as JSON:
+
+    program, mode, size, processors, repeats, median_s, p95_s, mean_s, min_s,
+    speedup, efficiency
+
+Speedup and efficiency are relative to the smallest rank count p0 in --ranks,
+the same axes as MPI/Speedup.png and MPI/Efficiency.png:
+  strong: the input is fixed; speedup = T(p0) / T(p), efficiency = speedup * p0 / p
+  weak:   the input grows with p (size x p / p0); efficiency = T(p0) / T(p),
+          speedup = efficiency * p / p0 (scaled speedup)
+
+Inputs come from Map-Reduce/generate: banded q1 matrices (binary CSR, read with
+--input) and G(n, m) graphs for q2. Build everything first with bench/build.sh.
+
+    bench/scaling.py --ranks=1,2,4 --sizes=small --repeats=5
+    bench/scaling.py --programs=q2 --modes=weak --q2-flags="--ordered --combine"
+"""
+import argparse
+import json
+import math
+import os
+import shlex
+import statistics
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+# Base inputs per size: q1 is an N x N band times an N x N band,
+# q2 a G(n, m) graph with n vertices and m edges
+SIZES = {
+    "q1": {"small": {"n": 20000}, "medium": {"n": 200000}, "large": {"n": 2000000}},
+    "q2": {"small": {"n": 20000, "m": 100000}, "medium": {"n": 200000, "m": 1000000},
+           "large": {"n": 2000000, "m": 10000000}},
+}
+
+
+def percentile(sorted_samples, p):
+    """Nearest-rank percentile, as in bench/kernels.cpp"""
+    i = math.ceil(p * len(sorted_samples)) - 1
+    return sorted_samples[max(0, min(len(sorted_samples) - 1, i))]
+
+
+def make_input(args, program, size, factor):
+    """Generates (once) the input for `program` at `size` scaled by `factor`;
+    returns the directory to run in and the extra arguments"""
+    base = SIZES[program][size]
+    n = base["n"] * factor
+    name = f"{program}_{size}_x{factor}"
+    directory = os.path.join(args.work, name)
+    generate = os.path.join(args.bin, "generate")
+    if program == "q1":
+        path = os.path.join(directory, "ab.bin")
+        if not os.path.exists(path):
+            os.makedirs(directory, exist_ok=True)
+            subprocess.run([generate, "band", str(n), str(n), str(n), "--binary", f"--out={path}",
+                            f"--seed={args.seed}"], check=True, stdout=subprocess.DEVNULL)
+        return directory, [f"--input={path}"]
+    path = os.path.join(directory, "input.txt")
+    if not os.path.exists(path):
+        os.makedirs(directory, exist_ok=True)
+        m = base["m"] * factor
+        subprocess.run([generate, "er", str(n), str(m), f"--out={path}", f"--seed={args.seed}"],
+                       check=True, stdout=subprocess.DEVNULL)
+    return directory, ["--header"]  # q2 reads input.txt from its working directory
+
+
+def run_once(args, program, ranks, directory, extra):
+    """One mpirun; returns the slowest rank's time from the profile report"""
+    flags = shlex.split(args.q1_flags if program == "q1" else args.q2_flags)
+    with tempfile.NamedTemporaryFile(suffix=".json", dir=args.work, delete=False) as f:
+        profile = f.name
+    command = (shlex.split(args.mpirun) + ["-np", str(ranks), os.path.join(args.bin, program)]
+               + extra + flags + [f"--profile={profile}"])
+    try:
+        done = subprocess.run(command, cwd=directory, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE,
+                              text=True, timeout=args.timeout)
+        if done.returncode != 0:
+            sys.exit(f"failed ({done.returncode}): {' '.join(command)}\n{done.stderr[-2000:]}")
+        with open(profile) as f:
+            report = json.loads(f.read().strip().splitlines()[-1])
+        return report["total_seconds"]["max"]
+    finally:
+        os.unlink(profile)
+
+
+def measure(args, program, mode, size, ranks, p0):
+    factor = ranks // p0 if mode == "weak" else 1
+    directory, extra = make_input(args, program, size, factor)
+    for _ in range(args.warmup):
+        run_once(args, program, ranks, directory, extra)
+    samples = sorted(run_once(args, program, ranks, directory, extra) for _ in range(args.repeats))
+    return {
+        "program": program, "mode": mode, "size": size, "processors": ranks, "repeats": len(samples),
+        "median_s": statistics.median(samples), "p95_s": percentile(samples, 0.95),
+        "mean_s": statistics.fmean(samples), "min_s": samples[0], "samples_s": samples,
+    }
+
+
+def add_scaling(points, p0):
+    """Fills speedup / efficiency from the median times, relative to p0"""
+    base = points[0]["median_s"]
+    for point in points:
+        ratio = point["processors"] / p0
+        t = point["median_s"]
+        if point["mode"] == "strong":
+            point["speedup"] = base / t if t > 0 else 0.0
+            point["efficiency"] = point["speedup"] / ratio
+        else:
+            point["efficiency"] = base / t if t > 0 else 0.0
+            point["speedup"] = point["efficiency"] * ratio
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--programs", default="q1,q2")
+    parser.add_argument("--modes", default="strong,weak")
+    parser.add_argument("--sizes", default="small")
+    parser.add_argument("--ranks", default="1,2,4")
+    parser.add_argument("--repeats", type=int, default=5)
+    parser.add_argument("--warmup", type=int, default=1)
+    parser.add_argument("--q1-flags", default="--dist=rows")
+    parser.add_argument("--q2-flags", default="")
+    parser.add_argument("--mpirun", default="mpirun --oversubscribe")
+    parser.add_argument("--bin", default=os.path.join(HERE, "bin"))
+    parser.add_argument("--work", default=os.path.join(HERE, "work"), help="generated inputs are kept here")
+    parser.add_argument("--out", default=os.path.join(HERE, "results", "scaling"),
+                        help="writes OUT.csv and OUT.json")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--timeout", type=float, default=3600)
+    args = parser.parse_args()
+    args.work = os.path.abspath(args.work)
+    args.bin = os.path.abspath(args.bin)
+
+    ranks = sorted(int(r) for r in args.ranks.split(","))
+    p0 = ranks[0]
+    for program in args.programs.split(","):
+        if not os.path.exists(os.path.join(args.bin, program)):
+            sys.exit(f"{args.bin}/{program} missing; run bench/build.sh first")
+
+    os.makedirs(args.work, exist_ok=True)
+    records = []
+    for program in args.programs.split(","):
+        for mode in args.modes.split(","):
+            for size in args.sizes.split(","):
+                points = []
+                for p in ranks:
+                    point = measure(args, program, mode, size, p, p0)
+                    points.append(point)
+                    print(f"{program} {mode} {size} p={p}: median {point['median_s']:.4f}s "
+                          f"p95 {point['p95_s']:.4f}s", file=sys.stderr)
+                add_scaling(points, p0)
+                records.extend(points)
+
+    columns = ["program", "mode", "size", "processors", "repeats", "median_s", "p95_s", "mean_s", "min_s",
+               "speedup", "efficiency"]
+    os.makedirs(os.path.dirname(os.path.abspath(args.out)), exist_ok=True)
+    with open(args.out + ".csv", "w") as f:
+        f.write(",".join(columns) + "\n")
+        for r in records:
+            f.write(",".join(f"{r[c]:.6g}" if isinstance(r[c], float) else str(r[c]) for c in columns) + "\n")
+    with open(args.out + ".json", "w") as f:
+        json.dump({"mpirun": args.mpirun, "q1_flags": args.q1_flags, "q2_flags": args.q2_flags,
+                   "warmup": args.warmup, "points": records}, f, indent=1)
+    print(f"wrote {args.out}.csv and {args.out}.json", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
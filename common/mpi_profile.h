@@ -0,0 +1,322 @@
+// Lightweight instrumentation shared by q1 and q2.
+//
+// Each rank records exclusive wall time per named phase, calls / bytes / messages per
+// collective (attributed to the phase it ran in), and its peak RSS. At the end
+// rank 0 reduces the records across ranks and emits one JSON line with the
+// max, mean, min and max/mean imbalance of every quantity.
+//
+// Off by default: a disabled profiler costs one predictable branch per phase
+// or collective, and building with -DMPI_PROFILE_OFF removes even that.
+//
+//   profiler.phase("read");            // ends the current phase, starts "read"
+//   ScopedPhase phase("shuffle");      // nested: "shuffle" until scope exit
+//   MPI_Alltoallv(...);
+//   profiler.exchange("Alltoallv", send_counts, recv_counts, size, sizeof(T));
+//   profiler.report("q2", path);       // collective, every rank calls it
+#pragma once
+
+#include <mpi.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct Profiler {
+    struct PhaseRecord {
+        std::string name;
+        double seconds = 0;
+    };
+    struct CommRecord {
+        std::string key;  // "phase:Collective"
+        long long calls = 0, bytes_sent = 0, bytes_recv = 0, messages = 0;
+    };
+
+    bool enabled = false;
+    double run_start = 0, phase_start = 0;
+    std::string current_phase = "setup";
+    std::vector<PhaseRecord> phases;
+    std::vector<CommRecord> comms;
+    std::vector<std::pair<std::string, std::string>> meta;
+    std::vector<std::pair<std::string, long long>> counters;
+
+    bool on() const {
+#ifdef MPI_PROFILE_OFF
+        return false;
+#else
+        return enabled;
+#endif
+    }
+
+    // Starts the run clock; call right after MPI_Init
+    void enable() {
+        enabled = true;
+        run_start = phase_start = MPI_Wtime();
+    }
+
+    void add_phase_time(const std::string& name, double seconds) {
+        for (PhaseRecord& p : phases) {
+            if (p.name == name) {
+                p.seconds += seconds;
+                return;
+            }
+        }
+        phases.push_back({name, seconds});
+    }
+
+    // Charges the time since the last switch to the current phase
+    void switch_phase(const std::string& name) {
+        double now = MPI_Wtime();
+        add_phase_time(current_phase, now - phase_start);
+        current_phase = name;
+        phase_start = now;
+    }
+
+    // Ends the current phase and starts `name`, for straight-line code
+    void phase(const char* name) {
+        if (on()) switch_phase(name);
+    }
+
+    // One collective (or MPI-IO call) as seen by this rank: bytes it sent and
+    // received, and the number of non-empty point-to-point payloads it sent
+    void collective(const char* op, long long sent, long long recvd, long long messages) {
+        if (!on()) return;
+        std::string key = current_phase + ":" + op;
+        for (CommRecord& c : comms) {
+            if (c.key == key) {
+                c.calls++;
+                c.bytes_sent += sent;
+                c.bytes_recv += recvd;
+                c.messages += messages;
+                return;
+            }
+        }
+        comms.push_back({key, 1, sent, recvd, messages});
+    }
+
+    // Broadcast of `bytes` from `root`: the root sends one copy to every peer
+    void bcast(long long bytes, int root, MPI_Comm comm) {
+        if (!on()) return;
+        int me, n;
+        MPI_Comm_rank(comm, &me);
+        MPI_Comm_size(comm, &n);
+        if (me == root) collective("Bcast", bytes * (n - 1), 0, n - 1);
+        else collective("Bcast", 0, bytes, 0);
+    }
+
+    // Any personalized collective given its per-peer element counts; pass
+    // nullptr for a side this rank does not take part in (e.g. a non-root's
+    // receive side of a Gatherv)
+    void exchange(const char* op, const int* send_counts, const int* recv_counts, int n, long long elem_bytes) {
+        if (!on()) return;
+        long long sent = 0, recvd = 0, messages = 0;
+        for (int p = 0; p < n; p++) {
+            if (send_counts) {
+                sent += send_counts[p] * elem_bytes;
+                messages += send_counts[p] > 0;
+            }
+            if (recv_counts) recvd += recv_counts[p] * elem_bytes;
+        }
+        collective(op, sent, recvd, messages);
+    }
+
+    // Per-rank integer counter, reduced like the phase times
+    void count(const std::string& name, long long value) {
+        if (!on()) return;
+        for (auto& c : counters) {
+            if (c.first == name) {
+                c.second += value;
+                return;
+            }
+        }
+        counters.push_back({name, value});
+    }
+
+    // Run-wide string attribute, taken from rank 0
+    void note(const std::string& key, const std::string& value) {
+        if (on()) meta.push_back({key, value});
+    }
+
+    void report(const char* program, const std::string& path);
+};
+
+inline Profiler profiler;
+
+// Charges the time until scope exit to `name` (and not to the enclosing
+// phase); collectives issued meanwhile are attributed to it
+class ScopedPhase {
+public:
+    explicit ScopedPhase(const char* name) {
+        if (!profiler.on()) return;
+        active = true;
+        previous = profiler.current_phase;
+        profiler.switch_phase(name);
+    }
+    ~ScopedPhase() {
+        if (active) profiler.switch_phase(previous);
+    }
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+private:
+    bool active = false;
+    std::string previous;
+};
+
+// Peak resident set size of this process in KiB
+inline long long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+namespace profile_detail {
+
+struct Summary {
+    double max = 0, sum = 0, min = 0;
+    int ranks = 0;
+};
+
+inline void add(std::map<std::string, Summary>& table, std::vector<std::string>& order, const std::string& key,
+                double value) {
+    auto it = table.find(key);
+    if (it == table.end()) {
+        order.push_back(key);
+        it = table.emplace(key, Summary{value, 0, value, 0}).first;
+    }
+    Summary& s = it->second;
+    s.max = std::max(s.max, value);
+    s.min = std::min(s.min, value);
+    s.sum += value;
+    s.ranks++;
+}
+
+inline std::string escape(const std::string& in) {
+    std::string out;
+    for (char c : in) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+// {"max":..,"mean":..,"min":..,"imbalance":..}; ranks without the key count as 0
+inline void write_summary(std::ostringstream& out, const Summary& s, int size) {
+    double mean = s.sum / size;
+    double min = s.ranks < size ? std::min(s.min, 0.0) : s.min;
+    out << "{\"max\":" << s.max << ",\"mean\":" << mean << ",\"min\":" << min
+        << ",\"imbalance\":" << (mean > 0 ? s.max / mean : 1.0) << "}";
+}
+
+}  // namespace profile_detail
+
+// Gathers every rank's records on rank 0 and writes one JSON line, appended to
+// `path`, or to stderr when `path` is empty. Every rank must call this.
+inline void Profiler::report(const char* program, const std::string& path) {
+    if (!on()) return;
+    using namespace profile_detail;
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    switch_phase(current_phase);
+
+    // Plain text records, one per line: kind, key, values
+    std::ostringstream mine;
+    mine.precision(17);
+    mine << "T\ttotal\t" << MPI_Wtime() - run_start << "\n";
+    mine << "R\tpeak_rss_kb\t" << peak_rss_kb() << "\n";
+    for (const PhaseRecord& p : phases) mine << "P\t" << p.name << "\t" << p.seconds << "\n";
+    for (const auto& c : counters) mine << "N\t" << c.first << "\t" << c.second << "\n";
+    for (const CommRecord& c : comms) {
+        mine << "C\t" << c.key << "\t" << c.calls << "\t" << c.bytes_sent << "\t" << c.bytes_recv << "\t"
+             << c.messages << "\n";
+    }
+    std::string text = mine.str();
+    int len = text.size();
+    std::vector<int> lens(size), displs(size + 1, 0);
+    MPI_Gather(&len, 1, MPI_INT, lens.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        for (int p = 0; p < size; p++) displs[p + 1] = displs[p] + lens[p];
+    }
+    std::vector<char> all(rank == 0 ? displs[size] : 0);
+    MPI_Gatherv(text.data(), len, MPI_CHAR, all.data(), lens.data(), displs.data(), MPI_CHAR, 0, MPI_COMM_WORLD);
+    if (rank != 0) return;
+
+    std::map<std::string, Summary> scalars, phase_table, counter_table;
+    std::map<std::string, std::vector<Summary>> comm_table;  // calls, sent, recv, messages
+    std::vector<std::string> phase_order, counter_order, comm_order, scalar_order;
+    std::istringstream in(std::string(all.begin(), all.end()));
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string kind, key;
+        std::getline(fields, kind, '\t');
+        std::getline(fields, key, '\t');
+        if (kind == "C") {
+            if (!comm_table.count(key)) {
+                comm_order.push_back(key);
+                comm_table[key].assign(4, Summary());
+            }
+            std::vector<Summary>& row = comm_table[key];
+            for (Summary& s : row) {
+                double v;
+                fields >> v;
+                s.min = s.ranks == 0 ? v : std::min(s.min, v);
+                s.max = std::max(s.max, v);
+                s.sum += v;
+                s.ranks++;
+            }
+        } else {
+            double v;
+            fields >> v;
+            if (kind == "P") add(phase_table, phase_order, key, v);
+            else if (kind == "N") add(counter_table, counter_order, key, v);
+            else add(scalars, scalar_order, key, v);
+        }
+    }
+
+    std::ostringstream out;
+    out.precision(6);
+    out << "{\"program\":\"" << program << "\",\"ranks\":" << size;
+    for (const auto& m : meta) out << ",\"" << escape(m.first) << "\":\"" << escape(m.second) << "\"";
+    out << ",\"total_seconds\":";
+    write_summary(out, scalars["total"], size);
+    out << ",\"peak_rss_kb\":";
+    write_summary(out, scalars["peak_rss_kb"], size);
+    out << ",\"phases\":{";
+    for (size_t i = 0; i < phase_order.size(); i++) {
+        out << (i ? "," : "") << "\"" << escape(phase_order[i]) << "\":";
+        write_summary(out, phase_table[phase_order[i]], size);
+    }
+    out << "},\"counters\":{";
+    for (size_t i = 0; i < counter_order.size(); i++) {
+        const Summary& s = counter_table[counter_order[i]];
+        out << (i ? "," : "") << "\"" << escape(counter_order[i]) << "\":{\"total\":" << (long long)s.sum
+            << ",\"per_rank\":";
+        write_summary(out, s, size);
+        out << "}";
+    }
+    out << "},\"collectives\":{";
+    for (size_t i = 0; i < comm_order.size(); i++) {
+        const std::vector<Summary>& row = comm_table[comm_order[i]];
+        out << (i ? "," : "") << "\"" << escape(comm_order[i]) << "\":{\"calls\":" << (long long)row[0].max
+            << ",\"bytes_sent\":" << (long long)row[1].sum << ",\"bytes_recv\":" << (long long)row[2].sum
+            << ",\"messages\":" << (long long)row[3].sum << ",\"max_rank_bytes_sent\":" << (long long)row[1].max
+            << ",\"bytes_sent_imbalance\":" << (row[1].sum > 0 ? row[1].max * size / row[1].sum : 1.0) << "}";
+    }
+    out << "}}\n";
+
+    std::string json = out.str();
+    if (path.empty()) {
+        fputs(json.c_str(), stderr);
+    } else if (FILE* f = fopen(path.c_str(), "a")) {
+        fputs(json.c_str(), f);
+        fclose(f);
+    } else {
+        fprintf(stderr, "Error: could not open %s for the profile.\n", path.c_str());
+    }
+}
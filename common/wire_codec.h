@@ -0,0 +1,173 @@
+// Optional compressed wire format for the integer streams q1 and q2 exchange.
+//
+// Integers go out as LEB128 varints: 7 bits per byte, high bit set on every
+// byte but the last. Signed values are zigzag-mapped first (0, -1, 1, -2 ..
+// -> 0, 1, 2, 3 ..) so small negatives stay short. Index streams that are
+// sorted, or sorted in runs (CSR columns row by row, vertex ids), are sent as
+// zigzag deltas from the previous value, so a sorted run costs one byte per
+// entry while gaps stay under 128.
+//
+// Each call site encodes into a byte buffer, moves it with its usual
+// collective as MPI_BYTE, and decodes on arrival. wire_codec keeps raw vs.
+// wire bytes and encode / decode time per named exchange, and report()
+// prints them reduced across ranks.
+//
+//   WireWriter w(buf);
+//   w.deltas(cols, n);                         // sorted index stream
+//   w.values(vals, n);                         // anything else
+//   WireReader r(buf.data(), buf.size());
+//   r.deltas(cols, n);
+//   r.values(vals, n);
+#pragma once
+
+#include <mpi.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+inline uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+inline int64_t unzigzag(uint64_t u) { return (int64_t)(u >> 1) ^ -(int64_t)(u & 1); }
+
+// Appends varints to a byte buffer
+struct WireWriter {
+    std::vector<char>& out;
+    explicit WireWriter(std::vector<char>& out) : out(out) {}
+
+    void put(uint64_t u) {
+        while (u >= 0x80) {
+            out.push_back((char)(u | 0x80));
+            u >>= 7;
+        }
+        out.push_back((char)u);
+    }
+    void put_signed(int64_t v) { put(zigzag(v)); }
+
+    template <class T>
+    void values(const T* v, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            if (std::is_signed<T>::value) put_signed((int64_t)v[i]);
+            else put((uint64_t)v[i]);
+        }
+    }
+
+    // Each value as its difference from the one before (the first from 0)
+    template <class T>
+    void deltas(const T* v, size_t n) {
+        int64_t prev = 0;
+        for (size_t i = 0; i < n; i++) {
+            put_signed((int64_t)v[i] - prev);
+            prev = (int64_t)v[i];
+        }
+    }
+};
+
+// Reads varints back in the order they were written
+struct WireReader {
+    const unsigned char* p;
+    const unsigned char* end;
+    WireReader(const char* data, size_t bytes) : p((const unsigned char*)data), end(p + bytes) {}
+
+    uint64_t get() {
+        uint64_t u = 0;
+        for (int shift = 0; p < end; shift += 7) {
+            unsigned char b = *p++;
+            u |= (uint64_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) break;
+        }
+        return u;
+    }
+    int64_t get_signed() { return unzigzag(get()); }
+
+    template <class T>
+    void values(T* v, size_t n) {
+        for (size_t i = 0; i < n; i++) v[i] = std::is_signed<T>::value ? (T)get_signed() : (T)get();
+    }
+
+    template <class T>
+    void deltas(T* v, size_t n) {
+        int64_t prev = 0;
+        for (size_t i = 0; i < n; i++) {
+            prev += get_signed();
+            v[i] = (T)prev;
+        }
+    }
+};
+
+// Per-exchange accounting, in the spirit of the profiler: off unless
+// enable()d, and every call site pays one branch when it is off
+struct WireCodec {
+    struct Record {
+        std::string name;
+        long long calls = 0, raw_bytes = 0, wire_bytes = 0;
+        double encode_seconds = 0, decode_seconds = 0;
+    };
+
+    bool enabled = false;
+    std::vector<Record> records;
+
+    void enable() { enabled = true; }
+    bool on() const { return enabled; }
+
+    Record& at(const char* name) {
+        for (Record& r : records) {
+            if (r.name == name) return r;
+        }
+        records.push_back({name});
+        return records.back();
+    }
+
+    // One payload this rank encoded: its size raw and on the wire, and the
+    // time spent encoding it
+    void encoded(const char* name, long long raw_bytes, long long wire_bytes, double seconds) {
+        Record& r = at(name);
+        r.calls++;
+        r.raw_bytes += raw_bytes;
+        r.wire_bytes += wire_bytes;
+        r.encode_seconds += seconds;
+    }
+
+    void decoded(const char* name, double seconds) { at(name).decode_seconds += seconds; }
+
+    // Sums bytes over ranks and takes the slowest rank's times; rank 0 prints
+    // one line for each of `names` that any rank used. Every rank must call
+    // this with the same names.
+    void report(std::initializer_list<const char*> names) {
+        if (!on()) return;
+        int rank;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        size_t n = names.size();
+        std::vector<long long> bytes(3 * n), total_bytes(3 * n);
+        std::vector<double> seconds(2 * n), max_seconds(2 * n);
+        size_t i = 0;
+        for (const char* name : names) {
+            const Record& r = at(name);
+            bytes[3 * i] = r.calls;
+            bytes[3 * i + 1] = r.raw_bytes;
+            bytes[3 * i + 2] = r.wire_bytes;
+            seconds[2 * i] = r.encode_seconds;
+            seconds[2 * i + 1] = r.decode_seconds;
+            i++;
+        }
+        MPI_Reduce(bytes.data(), total_bytes.data(), 3 * n, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(seconds.data(), max_seconds.data(), 2 * n, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (rank != 0) return;
+        fprintf(stderr, "--- WIRE CODEC ---\n");
+        i = 0;
+        for (const char* name : names) {
+            long long calls = total_bytes[3 * i], raw = total_bytes[3 * i + 1], wire = total_bytes[3 * i + 2];
+            if (calls > 0) {
+                fprintf(stderr, "EXCHANGE: %s PAYLOADS: %lld RAW_BYTES: %lld WIRE_BYTES: %lld RATIO: %.3f "
+                        "ENCODE_S: %.6f DECODE_S: %.6f\n",
+                        name, calls, raw, wire, wire > 0 ? (double)raw / wire : 1.0, max_seconds[2 * i],
+                        max_seconds[2 * i + 1]);
+            }
+            i++;
+        }
+    }
+};
+
+inline WireCodec wire_codec;
@@ -0,0 +1,102 @@
+"""Ingest and query latency of the matrix engine as the matrix grows,
+against the old server path (np.array over the row lists, then
+matrix_rank / det from scratch on every query).
+
+    python3 bench_engine.py [--sizes=100,200,400,800,1600] [--queries=20] [--baseline-max=1600]
+
+For every size n, the rows of a random n x n matrix are appended one at a
+time, then rank and determinant are queried --queries times. It prints CSV
+rows: n, operation, backend, and median and p95 latency in microseconds.
+Append latency covers all n rows, so it shows the O(rank * n) cost
+of each LU update rising with n. The numpy baseline is skipped above
+--baseline-max, where each query takes seconds. Each size's results, and a
+few badly scaled matrices checked first, must agree with numpy.
+"""
+import argparse
+import statistics
+import time
+
+import numpy as np
+
+from matrix_engine import MatrixEngine
+
+
+def summarize(samples):
+    samples = sorted(samples)
+    p95 = samples[min(len(samples) - 1, max(0, int(np.ceil(0.95 * len(samples))) - 1))]
+    return statistics.median(samples) * 1e6, p95 * 1e6
+
+
+def timed(fn, repeats):
+    samples = []
+    for _ in range(repeats):
+        start = time.perf_counter()
+        fn()
+        samples.append(time.perf_counter() - start)
+    return samples
+
+
+# Badly scaled matrices, where squaring entries overflows or underflows
+SCALED_CASES = [
+    [[1e200, 1e200], [1e200, -1e200]],
+    [[1e200, 2e200], [0.5e200, 1e200]],
+    [[1e-200, 1e-200], [1e-200, -1e-200]],
+]
+
+
+def check_scaled_cases():
+    """The engine's rank and determinant must match numpy's on SCALED_CASES"""
+    for rows in SCALED_CASES:
+        engine = MatrixEngine()
+        for row in rows:
+            engine.append(row)
+        matrix = np.array(rows, dtype=float)
+        assert engine.rank() == np.linalg.matrix_rank(matrix), rows
+        assert np.isclose(engine.determinant(), np.linalg.det(matrix), rtol=1e-6), rows
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--sizes", default="100,200,400,800,1600")
+    parser.add_argument("--queries", type=int, default=20)
+    parser.add_argument("--baseline-max", type=int, default=1600)
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    np.seterr(over="ignore")  # large random determinants overflow in both backends
+    check_scaled_cases()
+    print("n,operation,backend,median_us,p95_us")
+    for n in (int(s) for s in args.sizes.split(",")):
+        rows = np.random.default_rng(args.seed).standard_normal((n, n)).tolist()
+        engine, lists = MatrixEngine(), []
+        append_engine, append_lists = [], []
+        for row in rows:
+            start = time.perf_counter()
+            engine.append(row)
+            append_engine.append(time.perf_counter() - start)
+            start = time.perf_counter()
+            lists.append(list(row))
+            append_lists.append(time.perf_counter() - start)
+
+        results = [("append", "engine", append_engine),
+                   ("rank", "engine", timed(engine.rank, args.queries)),
+                   ("determinant", "engine", timed(engine.determinant, args.queries))]
+        if n <= args.baseline_max:
+            results += [
+                ("append", "numpy", append_lists),
+                ("rank", "numpy", timed(lambda: np.linalg.matrix_rank(np.array(lists, dtype=float)),
+                                        args.queries)),
+                ("determinant", "numpy", timed(lambda: np.linalg.det(np.array(lists, dtype=float)),
+                                               args.queries)),
+            ]
+            # The maintained factors must agree with a from-scratch factorization
+            matrix = np.array(lists, dtype=float)
+            assert engine.rank() == np.linalg.matrix_rank(matrix)
+            assert np.isclose(engine.determinant(), np.linalg.det(matrix), rtol=1e-6)
+        for operation, backend, samples in results:
+            median, p95 = summarize(samples)
+            print(f"{n},{operation},{backend},{median:.2f},{p95:.2f}", flush=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,6 +1,18 @@
 import grpc
 import matrix_service_pb2
 import matrix_service_pb2_grpc
+from array import array
+
+def row_blocks(client_id, rows, block_rows=256):
+    """Packs equal-length rows into RowBlock messages for the SendRows stream"""
+    for start in range(0, len(rows), block_rows):
+        block = rows[start:start + block_rows]
+        yield matrix_service_pb2.RowBlock(
+            client_id=client_id,
+            rows=len(block),
+            cols=len(block[0]),
+            data=array('d', (v for row in block for v in row)).tobytes()
+        )
 
 class DynamicThresholdClient:
     def __init__(self, client_id, server_address='localhost:50051'):
@@ -74,6 +86,19 @@ class DynamicThresholdClient:
         except grpc.RpcError as e:
             print(f"RPC Error sending row: {e}")
 
+    def send_rows_streamed(self, rows, block_rows=256):
+        """Uploads many rows in one SendRows stream instead of an RPC per row"""
+        try:
+            response = self.stub.SendRows(row_blocks(self.client_id, rows, block_rows))
+            if response.success:
+                print(f"{len(rows)} rows sent in blocks of {block_rows}.")
+            else:
+                print(f"Send rows failed: {response.message}")
+            return response.success
+        except grpc.RpcError as e:
+            print(f"RPC Error sending rows: {e}")
+            return False
+
     def query_rank(self):
         """Option 3: Query if matrix has rank at least r"""
         try:
@@ -0,0 +1,131 @@
+"""Load test for MatrixService: concurrent uploaders and queriers against a
+local server, reporting ingest rows/sec and query latency percentiles.
+
+    python3 load_test.py [--clients=4] [--rows=10000] [--cols=64] [--block=256]
+                         [--queriers=4] [--mode=stream|unary] [--address=HOST:PORT]
+
+Without --address it starts server.py on a free port and stops it at the end.
+Every client runs in its own process with its own channel. Each uploads
+--rows random rows, either through one SendRows stream of --block-row blocks
+(stream) or one SendRow per row (unary). The queriers issue rank queries back
+to back for the whole upload. Build libmatrix_engine.so and the protobuf
+modules first (see Readmi.md).
+"""
+import argparse
+import multiprocessing as mp
+import os
+import socket
+import statistics
+import subprocess
+import sys
+import time
+
+import grpc
+import numpy as np
+
+import matrix_service_pb2
+import matrix_service_pb2_grpc
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def uploader(address, client_id, args, start, results):
+    stub = matrix_service_pb2_grpc.MatrixServiceStub(grpc.insecure_channel(address))
+    rows = np.random.default_rng(client_id).standard_normal((args.rows, args.cols))
+    start.wait()
+    t0 = time.perf_counter()
+    if args.mode == "stream":
+        def blocks():
+            for lo in range(0, args.rows, args.block):
+                block = rows[lo:lo + args.block]
+                yield matrix_service_pb2.RowBlock(client_id=client_id, rows=len(block), cols=args.cols,
+                                                  data=block.astype("<f8").tobytes())
+        ok = stub.SendRows(blocks()).success
+    else:
+        ok = all(stub.SendRow(matrix_service_pb2.MatrixRow(client_id=client_id, values=row)).success
+                 for row in rows.tolist())
+    results.put(("upload", ok, time.perf_counter() - t0, args.rows))
+
+
+def querier(address, client_id, start, done, results):
+    stub = matrix_service_pb2_grpc.MatrixServiceStub(grpc.insecure_channel(address))
+    request = matrix_service_pb2.QueryRequest(client_id=client_id, query_type=2)
+    stub.Query(request)  # connect before the clock starts
+    latencies = []
+    start.wait()
+    while not done.is_set():
+        t0 = time.perf_counter()
+        stub.Query(request)
+        latencies.append(time.perf_counter() - t0)
+    results.put(("query", True, latencies, 0))
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(("localhost", 0))
+        return s.getsockname()[1]
+
+
+def wait_for_server(address, timeout=10):
+    channel = grpc.insecure_channel(address)
+    grpc.channel_ready_future(channel).result(timeout=timeout)
+    channel.close()
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--clients", type=int, default=4)
+    parser.add_argument("--rows", type=int, default=10000, help="rows per client")
+    parser.add_argument("--cols", type=int, default=64)
+    parser.add_argument("--block", type=int, default=256, help="rows per RowBlock")
+    parser.add_argument("--queriers", type=int, default=4)
+    parser.add_argument("--mode", choices=["stream", "unary"], default="stream")
+    parser.add_argument("--address")
+    args = parser.parse_args()
+
+    server = None
+    address = args.address
+    if not address:
+        port = free_port()
+        address = f"localhost:{port}"
+        server = subprocess.Popen([sys.executable, os.path.join(HERE, "server.py"), str(port)],
+                                  cwd=HERE, stdout=subprocess.DEVNULL)
+    try:
+        wait_for_server(address)
+        start, done = mp.Barrier(args.clients + args.queriers + 1), mp.Event()
+        results = mp.Queue()
+        uploaders = [mp.Process(target=uploader, args=(address, 1 + i, args, start, results))
+                     for i in range(args.clients)]
+        queriers = [mp.Process(target=querier, args=(address, 1000 + i, start, done, results))
+                    for i in range(args.queriers)]
+        for p in uploaders + queriers:
+            p.start()
+        start.wait()
+        t0 = time.perf_counter()
+        uploads = [results.get() for _ in uploaders]
+        elapsed = time.perf_counter() - t0
+        done.set()
+        queries = [results.get() for _ in queriers]
+        for p in uploaders + queriers:
+            p.join()
+    finally:
+        if server:
+            server.terminate()
+            server.wait()
+
+    rows = sum(u[3] for u in uploads)
+    failed = sum(not u[1] for u in uploads)
+    latencies = sorted(x for q in queries for x in q[2])
+    print(f"mode={args.mode} clients={args.clients} rows/client={args.rows} cols={args.cols} "
+          f"block={args.block} queriers={args.queriers}")
+    print(f"ingest: {rows} rows in {elapsed:.3f}s = {rows / elapsed:.0f} rows/s"
+          + (f" ({failed} uploads FAILED)" if failed else ""))
+    if latencies:
+        pct = lambda p: latencies[min(len(latencies) - 1, int(p * len(latencies)))] * 1e3
+        print(f"query: {len(latencies)} during ingest, p50 {statistics.median(latencies) * 1e3:.3f} ms, "
+              f"p99 {pct(0.99):.3f} ms, max {latencies[-1] * 1e3:.3f} ms")
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,38 @@
+// C interface to MatrixEngine for the Python server (loaded with ctypes).
+//
+//   g++ -O2 -std=c++17 -shared -fPIC -o libmatrix_engine.so matrix_engine.cpp
+#include "matrix_engine.h"
+
+extern "C" {
+
+MatrixEngine* matrix_engine_new() { return new MatrixEngine(); }
+
+void matrix_engine_free(MatrixEngine* e) { delete e; }
+
+// 1 on success, 0 on a column count mismatch
+int matrix_engine_append(MatrixEngine* e, const double* values, int n) { return e->append(values, n); }
+
+// Appends `rows` rows of n values from row-major `values`; returns how many
+// went in (fewer than `rows` only on a column count mismatch)
+int matrix_engine_append_rows(MatrixEngine* e, const double* values, int rows, int n) {
+    for (int i = 0; i < rows; i++) {
+        if (!e->append(values + (size_t)i * n, n)) return i;
+    }
+    return rows;
+}
+
+int matrix_engine_rows(const MatrixEngine* e) { return e->rows(); }
+
+int matrix_engine_cols(const MatrixEngine* e) { return e->cols(); }
+
+int matrix_engine_rank(const MatrixEngine* e) { return e->rank(); }
+
+// 1 and the determinant in *out, or 0 when the matrix is not square
+int matrix_engine_determinant(const MatrixEngine* e, double* out) { return e->determinant(*out); }
+
+// Copies row i (cols() values) into out
+void matrix_engine_row(const MatrixEngine* e, int i, double* out) {
+    const double* r = e->row(i);
+    for (int c = 0; c < e->cols(); c++) out[c] = r[c];
+}
+}
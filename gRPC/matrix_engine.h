@@ -0,0 +1,128 @@
+// Row-by-row matrix store for MatrixService with an incrementally maintained
+// pivoted LU factorization, so rank and determinant queries cost O(1).
+//
+// Appending row i eliminates it against the i' < i independent rows kept so
+// far (the rows of U), in order: each U row j has a pivot column p_j and is
+// zero in the pivot columns of the rows before it, so after subtracting
+// multiples of U_0 .. U_{r-1} the residual is zero in every existing pivot
+// column. A residual above the tolerance becomes U_r, pivoting on its largest
+// entry; otherwise the row is dependent. Each append is O(r * cols) and
+// touches only contiguous storage.
+//
+// This is A = L U with unit lower triangular L (the row operations) and U
+// triangular up to the column permutation p, so for a square A
+// det(A) = sign(p) * prod U_j[p_j], and rank(A) = r. The product is kept as a
+// mantissa and a binary exponent so long products do not overflow midway, and
+// sign(p) is kept by counting inversions with a Fenwick tree over columns.
+// Pivoted LU reveals the rank reliably in practice, though unlike the SVD
+// behind numpy.linalg.matrix_rank it is not guaranteed to on contrived inputs.
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <vector>
+
+class MatrixEngine {
+public:
+    // Fixes the column count on the first row; false if `n` does not match it
+    bool append(const double* values, int n) {
+        if (cols_ == 0) {
+            if (n <= 0) return false;
+            cols_ = n;
+            fenwick_.assign(n + 1, 0);
+        } else if (n != cols_) {
+            return false;
+        }
+        rows_.insert(rows_.end(), values, values + n);
+        row_count_++;
+        if (rank() < cols_) eliminate(values);
+        return true;
+    }
+
+    int rows() const { return row_count_; }
+    int cols() const { return cols_; }
+    int rank() const { return (int)pivots_.size(); }
+    const double* row(int i) const { return rows_.data() + (size_t)i * cols_; }
+
+    // Determinant of a square matrix; false when it is not square
+    bool determinant(double& out) const {
+        if (row_count_ == 0 || row_count_ != cols_) return false;
+        if (rank() < cols_) {
+            out = 0.0;
+            return true;
+        }
+        long long e = std::min<long long>(std::max<long long>(exponent_, INT_MIN), INT_MAX);
+        out = std::ldexp(odd_inversions_ ? -mantissa_ : mantissa_, (int)e);
+        return true;
+    }
+
+private:
+    int cols_ = 0, row_count_ = 0;
+    std::vector<double> rows_;  // every row, row-major
+    std::vector<double> u_;     // rank() independent rows of U, row-major
+    std::vector<int> pivots_;   // pivot column of each U row
+    std::vector<double> norms_; // 2-norm of each U row
+    std::vector<int> fenwick_;  // pivot columns taken, for the permutation sign
+    double mantissa_ = 1.0;     // product of the pivots = mantissa_ * 2^exponent_
+    long long exponent_ = 0;
+    bool odd_inversions_ = false;
+
+    void eliminate(const double* values) {
+        std::vector<double> r(values, values + cols_);
+        double bound = norm(values);
+        for (size_t j = 0; j < pivots_.size(); j++) {
+            const double* uj = u_.data() + j * cols_;
+            double f = r[pivots_[j]] / uj[pivots_[j]];
+            if (f == 0.0) continue;
+            for (int c = 0; c < cols_; c++) r[c] -= f * uj[c];
+            r[pivots_[j]] = 0.0;
+            bound += std::fabs(f) * norms_[j];
+        }
+
+        int p = 0;
+        for (int c = 1; c < cols_; c++) {
+            if (std::fabs(r[c]) > std::fabs(r[p])) p = c;
+        }
+        // numpy's default tolerance, max(rows, cols) * eps * scale, where the
+        // scale is the size of everything that went into the residual: what is
+        // left of a dependent row is rounding error of a few eps * bound. The
+        // factor 64 covers that; independent rows sit many orders above it.
+        double tol = 64.0 * std::max(row_count_, cols_) * DBL_EPSILON * bound;
+        if (!(std::fabs(r[p]) > tol)) return;
+
+        // Earlier pivots in higher columns are the inversions this one adds
+        int higher = rank() - taken_up_to(p);
+        if (higher & 1) odd_inversions_ = !odd_inversions_;
+        for (int i = p + 1; i <= cols_; i += i & -i) fenwick_[i]++;
+
+        int e;
+        mantissa_ = std::frexp(mantissa_ * r[p], &e);
+        exponent_ += e;
+        u_.insert(u_.end(), r.begin(), r.end());
+        norms_.push_back(norm(r.data()));
+        pivots_.push_back(p);
+    }
+
+    // Scaled by the largest entry, so squaring neither overflows huge rows
+    // (|x| above ~1e154) nor flushes tiny ones to zero
+    double norm(const double* v) const {
+        double scale = 0.0;
+        for (int c = 0; c < cols_; c++) scale = std::max(scale, std::fabs(v[c]));
+        if (scale == 0.0 || !std::isfinite(scale)) return scale;
+        double sum = 0.0;
+        for (int c = 0; c < cols_; c++) {
+            double x = v[c] / scale;
+            sum += x * x;
+        }
+        return scale * std::sqrt(sum);
+    }
+
+    // Number of pivot columns <= c
+    int taken_up_to(int c) const {
+        int n = 0;
+        for (int i = c + 1; i > 0; i -= i & -i) n += fenwick_[i];
+        return n;
+    }
+};
@@ -0,0 +1,82 @@
+"""Python side of the native matrix engine (matrix_engine.h), through ctypes.
+
+Build the library next to this file before starting the server:
+
+    g++ -O2 -std=c++17 -shared -fPIC -o libmatrix_engine.so matrix_engine.cpp
+
+MATRIX_ENGINE_LIB overrides the library path.
+"""
+import ctypes
+import os
+
+_LIB_PATH = os.environ.get(
+    "MATRIX_ENGINE_LIB", os.path.join(os.path.dirname(os.path.abspath(__file__)), "libmatrix_engine.so"))
+
+
+def _load():
+    if not os.path.exists(_LIB_PATH):
+        raise ImportError(f"{_LIB_PATH} not found; build it with: "
+                          "g++ -O2 -std=c++17 -shared -fPIC -o libmatrix_engine.so matrix_engine.cpp")
+    lib = ctypes.CDLL(_LIB_PATH)
+    handle, doubles = ctypes.c_void_p, ctypes.POINTER(ctypes.c_double)
+    lib.matrix_engine_new.restype = handle
+    lib.matrix_engine_free.argtypes = [handle]
+    lib.matrix_engine_append.argtypes = [handle, doubles, ctypes.c_int]
+    lib.matrix_engine_append_rows.argtypes = [handle, ctypes.c_char_p, ctypes.c_int, ctypes.c_int]
+    for name in ("rows", "cols", "rank"):
+        getattr(lib, f"matrix_engine_{name}").argtypes = [handle]
+    lib.matrix_engine_determinant.argtypes = [handle, doubles]
+    lib.matrix_engine_row.argtypes = [handle, ctypes.c_int, doubles]
+    return lib
+
+
+_lib = _load()
+
+
+class MatrixEngine:
+    """Rows in contiguous native storage with an incrementally updated LU.
+    Appends cost O(rank * cols); rank() and determinant() are O(1)."""
+
+    def __init__(self):
+        self._e = _lib.matrix_engine_new()
+
+    def __del__(self):
+        if getattr(self, "_e", None):
+            _lib.matrix_engine_free(self._e)
+            self._e = None
+
+    def append(self, values):
+        """Adds one row; False if its length differs from the first row's"""
+        n = len(values)
+        row = (ctypes.c_double * n)(*values)
+        return bool(_lib.matrix_engine_append(self._e, row, n))
+
+    def append_rows(self, data, rows, cols):
+        """Adds `rows` rows packed row-major as float64 bytes in `data`; returns
+        how many were added (fewer only on a column count mismatch)"""
+        if len(data) != rows * cols * 8:
+            raise ValueError(f"expected {rows * cols * 8} bytes for {rows} x {cols}, got {len(data)}")
+        return _lib.matrix_engine_append_rows(self._e, data, rows, cols)
+
+    @property
+    def rows(self):
+        return _lib.matrix_engine_rows(self._e)
+
+    @property
+    def cols(self):
+        return _lib.matrix_engine_cols(self._e)
+
+    def rank(self):
+        return _lib.matrix_engine_rank(self._e)
+
+    def determinant(self):
+        """The determinant, or None when the matrix is not square"""
+        out = ctypes.c_double()
+        if not _lib.matrix_engine_determinant(self._e, ctypes.byref(out)):
+            return None
+        return out.value
+
+    def row(self, i):
+        out = (ctypes.c_double * self.cols)()
+        _lib.matrix_engine_row(self._e, i, out)
+        return list(out)
@@ -1,169 +1,166 @@
 import grpc
-import numpy as np
 from concurrent import futures
 import matrix_service_pb2
 import matrix_service_pb2_grpc
+from matrix_engine import MatrixEngine
+import sys
 import threading
-from datetime import datetime
+from array import array
+from collections import namedtuple
+
+# What queries see: an immutable summary published after every ingest batch.
+# Rank and determinant come from the engine's maintained factors, so building
+# one is O(1) and readers never wait on writers.
+MatrixSnapshot = namedtuple("MatrixSnapshot", ["rows", "cols", "rank", "determinant"])
 
 class DynamicThresholdMatrixServicer(matrix_service_pb2_grpc.MatrixServiceServicer):
     def __init__(self):
-        self.matrix_rows = []
-        self.matrix_cols = None
+        # Rows and their LU factors live in the native engine (matrix_engine.h);
+        # every SendRow updates the factors, so queries never refactor
+        self.engine = MatrixEngine()
         self.client_has_completed = {}
-        self.client_contributions = {}
+        self.client_rows = {}
         self.client_active_session = {}
-        self.lock = threading.Lock()
+        # Serializes writers only; Query reads self.snapshot without it
+        self.ingest_lock = threading.Lock()
+        self.snapshot = MatrixSnapshot(0, 0, 0, None)
+
+    def _rejected(self, client_id):
+        """Error response if the client may not send any more rows, else None"""
+        if client_id not in self.client_has_completed:
+            return None
+        client_name = 'A' if client_id == 1 else 'B'
+        error_msg = f"Client {client_name} has already completed data submission. Cannot send again."
+        print(f" REJECTED: {error_msg}")
+        return matrix_service_pb2.RowResponse(success=False, message=error_msg)
+
+    def _ingest(self, client_id, data, rows, cols):
+        """Appends `rows` packed rows and publishes a new snapshot; returns
+        (first row index, rows added)"""
+        with self.ingest_lock:
+            first_row = self.engine.rows
+            added = self.engine.append_rows(data, rows, cols)
+            if first_row == 0 and added:
+                print(f" Matrix columns detected: {self.engine.cols}")
+            self.client_rows[client_id] = self.client_rows.get(client_id, 0) + added
+            self.client_active_session[client_id] = True
+            # A single attribute store, so readers see the old or the new snapshot
+            self.snapshot = MatrixSnapshot(self.engine.rows, self.engine.cols, self.engine.rank(),
+                                           self.engine.determinant())
+        return first_row, added
+
+    def _mismatch(self, cols, total_rows):
+        error_msg = f"Row dimension mismatch. Expected {self.snapshot.cols} columns, got {cols}"
+        print(f" ERROR: {error_msg}")
+        return matrix_service_pb2.RowResponse(
+            success=False,
+            message=error_msg,
+            rows_received=total_rows,
+            total_expected_rows=total_rows
+        )
 
     def SendRow(self, request, context):
-        with self.lock:
-            client_id = request.client_id
-            values = list(request.values)
-            timestamp = datetime.now().strftime("%H:%M:%S")
-            client_name = 'A' if client_id == 1 else 'B'
-
-            # Check if client has already COMPLETED a session
-            if client_id in self.client_has_completed:
-                error_msg = f"Client {client_name} has already completed data submission. Cannot send again."
-                print(f" REJECTED: {error_msg}")
-                return matrix_service_pb2.RowResponse(
-                    success=False,
-                    message=error_msg
-                )
-
-            print(f" Client {client_name} sending row with {len(values)} values: {values}")
-
-            # Initialize matrix dimensions from first row
-            if self.matrix_cols is None:
-                self.matrix_cols = len(values)
-                # print(f"[{timestamp}] Matrix columns detected: {self.matrix_cols}")
-                print(f" Matrix columns detected: {self.matrix_cols}")
-
-            # Validate row dimensions
-            if len(values) != self.matrix_cols:
-                error_msg = f"Row dimension mismatch. Expected {self.matrix_cols} columns, got {len(values)}"
-                print(f" ERROR: {error_msg}")
-                return matrix_service_pb2.RowResponse(
-                    success=False,
-                    message=error_msg
-                )
-
-            # Auto-assign row index
-            row_index = len(self.matrix_rows)
-
-            # Store the row
-            self.matrix_rows.append(values)
-
-            # Track client contribution
-            if client_id not in self.client_contributions:
-                self.client_contributions[client_id] = []
-            self.client_contributions[client_id].append(row_index)
+        client_id = request.client_id
+        client_name = 'A' if client_id == 1 else 'B'
+        rejected = self._rejected(client_id)
+        if rejected:
+            return rejected
+
+        cols = len(request.values)
+        row_index, added = self._ingest(client_id, array('d', request.values).tobytes(), 1, cols)
+        if not added:
+            return self._mismatch(cols, self.snapshot.rows)
+
+        total_rows = row_index + 1
+        print(f" Client {client_name} row {row_index} stored ({cols} values, "
+              f"{self.client_rows[client_id]} from this client)")
+        return matrix_service_pb2.RowResponse(
+            success=True,
+            message=f"Row {row_index} received from client {client_name}",
+            rows_received=total_rows,
+            total_expected_rows=total_rows
+        )
+
+    def SendRows(self, request_iterator, context):
+        # Each block is one ingest batch: appended under the writer lock, then
+        # published, so queries interleave with a long upload
+        received = 0
+        client_id = None
+        for block in request_iterator:
+            if client_id is None:
+                client_id = block.client_id
+                rejected = self._rejected(client_id)
+                if rejected:
+                    return rejected
+            try:
+                _, added = self._ingest(client_id, block.data, block.rows, block.cols)
+            except ValueError as e:
+                return matrix_service_pb2.RowResponse(success=False, message=str(e), rows_received=received)
+            received += added
+            if added < block.rows:
+                return self._mismatch(block.cols, self.snapshot.rows)
+
+        client_name = 'A' if client_id == 1 else 'B'
+        total_rows = self.snapshot.rows
+        print(f" Client {client_name} streamed {received} rows (total {total_rows})")
+        return matrix_service_pb2.RowResponse(
+            success=True,
+            message=f"{received} rows received from client {client_name}",
+            rows_received=total_rows,
+            total_expected_rows=total_rows
+        )
 
-            # Mark client as having active session
-            self.client_active_session[client_id] = True
+    def Query(self, request, context):
+        snapshot = self.snapshot
+        query_type = request.query_type
+
+        # CHECK MATRIX DATA FIRST
+        if snapshot.rows == 0:
+            return matrix_service_pb2.QueryResponse(
+                success=False,
+                message="No matrix data available. Please send matrix data first."
+            )
 
-            total_rows = len(self.matrix_rows)
-            print(f" Row {row_index} stored successfully")
-            print(f" Total rows received: {total_rows}")
-            print(f" Client {client_name} rows so far: {self.client_contributions[client_id]}")
+        if query_type == 1:
+            return matrix_service_pb2.QueryResponse(
+                success=True,
+                message=f"Matrix has {snapshot.rows} rows",
+                row_count=snapshot.rows
+            )
 
-            return matrix_service_pb2.RowResponse(
+        elif query_type == 2:
+            return matrix_service_pb2.QueryResponse(
                 success=True,
-                message=f"Row {row_index} received from client {client_name}",
-                rows_received=total_rows,
-                total_expected_rows=total_rows
+                message=f"Actual rank: {snapshot.rank}",
+                rank=snapshot.rank
             )
 
-    def Query(self, request, context):
-        with self.lock:
-            client_id = request.client_id
-            query_type = request.query_type
-            timestamp = datetime.now().strftime("%H:%M:%S")
-            client_name = 'A' if client_id == 1 else 'B'
-
-            query_names = {1: "row_count", 2: "has_rank_at_least", 3: "has_determinant_at_least"}
-            query_name = query_names.get(query_type, "unknown")
-            print(f" Client {client_name} requesting {query_name}")
-
-            # CHECK MATRIX DATA FIRST
-            if not self.matrix_rows:
-                print(f" No matrix data available for query")
+        elif query_type == 3:
+            if snapshot.determinant is None:
                 return matrix_service_pb2.QueryResponse(
                     success=False,
-                    message="No matrix data available. Please send matrix data first."
+                    message=f"Dimensions not matched. Matrix is {snapshot.rows}×{snapshot.cols}, "
+                            f"need square matrix for determinant."
                 )
+            return matrix_service_pb2.QueryResponse(
+                success=True,
+                message=f"Actual determinant: {snapshot.determinant}",
+                determinant=snapshot.determinant
+            )
 
-            # REMOVED: Premature completion marking
-            # This was the problematic line that marked clients as completed after first query:
-            # if client_id in self.client_active_session and client_id not in self.client_has_completed:
-            #     self.client_has_completed[client_id] = True
-            #     print(f"[{timestamp}] Client {client_name} marked as completed data submission")
-
-            try:
-                matrix = np.array(self.matrix_rows, dtype=float)
-                print(f" Current matrix shape: {matrix.shape}")
-                print(f" Current matrix:")
-                for i, row in enumerate(matrix):
-                    client_info = "A" if i in self.client_contributions.get(1, []) else "B"
-                    print(f" Row {i} (Client {client_info}): {row}")
-
-                if query_type == 1: 
-                    result = matrix.shape[0]
-                    print(f" Row count: {result}")
-                    return matrix_service_pb2.QueryResponse(
-                        success=True,
-                        message=f"Matrix has {result} rows",
-                        row_count=result
-                    )
-
-                elif query_type == 2: 
-                    actual_rank = np.linalg.matrix_rank(matrix)
-                    print(f" Matrix rank: {actual_rank}")
-                    return matrix_service_pb2.QueryResponse(
-                        success=True,
-                        message=f"Actual rank: {actual_rank}",
-                        rank=actual_rank
-                    )
-
-                elif query_type == 3:  
-                    rows, cols = matrix.shape
-                    if rows != cols:
-                        error_msg = f"Dimensions not matched. Matrix is {rows}×{cols}, need square matrix for determinant."
-                        print(f" {error_msg}")
-                        return matrix_service_pb2.QueryResponse(
-                            success=False,
-                            message=error_msg
-                        )
-
-                    det = np.linalg.det(matrix)
-                    print(f" Determinant: {det}")
-                    return matrix_service_pb2.QueryResponse(
-                        success=True,
-                        message=f"Actual determinant: {det}",
-                        determinant=det
-                    )
-
-                else:
-                    return matrix_service_pb2.QueryResponse(
-                        success=False,
-                        message="Invalid query type. Use 1 (row count), 2 (rank), or 3 (determinant)"
-                    )
-
-            except Exception as e:
-                error_msg = f"Error processing {query_name}: {str(e)}"
-                print(f" ERROR: {error_msg}")
-                return matrix_service_pb2.QueryResponse(
-                    success=False,
-                    message=error_msg
-                )
+        else:
+            return matrix_service_pb2.QueryResponse(
+                success=False,
+                message="Invalid query type. Use 1 (row count), 2 (rank), or 3 (determinant)"
+            )
 
-def serve():
+def serve(port=50051):
     server = grpc.server(futures.ThreadPoolExecutor(max_workers=10))
     matrix_service_pb2_grpc.add_MatrixServiceServicer_to_server(
         DynamicThresholdMatrixServicer(), server
     )
 
-    listen_addr = '[::]:50051'
+    listen_addr = f'[::]:{port}'
     server.add_insecure_port(listen_addr)
     print(f"Listening on: {listen_addr}")
 
@@ -174,4 +171,5 @@ def serve():
         server.stop(0)
 
 if __name__ == '__main__':
-    serve()
+    # python3 server.py [port]
+    serve(int(sys.argv[1]) if len(sys.argv) > 1 else 50051)